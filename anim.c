@@ -0,0 +1,114 @@
+/*
+ * This file is part of the Atomiks project
+ * Copyright (C) Mateusz Viste 2013, 2014, 2015
+ *
+ * A tiny animation scheduler: tweens that move something across the screen
+ * over a given time, advanced by the main loop once per frame instead of
+ * blocking it.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>    /* memset() */
+#include "anim.h"      /* include self for control */
+
+
+void anim_clear(struct anim *a) {
+  memset(a, 0, sizeof(struct anim));
+}
+
+
+struct anim_tween *anim_add(struct anim *a, int kind, long start, long duration, int fromx, int fromy, int tox, int toy) {
+  struct anim_tween *t;
+  int i;
+  for (i = 0; i < ANIM_MAXTWEENS; i++) {
+    t = &(a->tween[i]);
+    if (t->kind != 0) continue;
+    memset(t, 0, sizeof(struct anim_tween));
+    t->kind = kind;
+    t->start = start;
+    t->duration = (duration > 0) ? duration : 1;
+    t->fromx = fromx;
+    t->fromy = fromy;
+    t->tox = tox;
+    t->toy = toy;
+    return(t);
+  }
+  return(NULL);
+}
+
+
+struct anim_tween *anim_find(struct anim *a, int kind) {
+  int i;
+  for (i = 0; i < ANIM_MAXTWEENS; i++) {
+    if (a->tween[i].kind == kind) return(&(a->tween[i]));
+  }
+  return(NULL);
+}
+
+
+int anim_busy(struct anim *a) {
+  int i;
+  for (i = 0; i < ANIM_MAXTWEENS; i++) {
+    if (a->tween[i].kind != 0) return(1);
+  }
+  return(0);
+}
+
+
+void anim_skip(struct anim_tween *t, long now) {
+  t->start = now - t->duration;
+}
+
+
+/* returns how far a tween is at a given time, from 0 to 1000 */
+static long progress(struct anim_tween *t, long now) {
+  if (now <= t->start) return(0);
+  if (now >= t->start + t->duration) return(1000);
+  return(((now - t->start) * 1000) / t->duration);
+}
+
+
+void anim_getpos(struct anim_tween *t, long now, int *x, int *y) {
+  long p = progress(t, now);
+  *x = t->fromx + ((t->tox - t->fromx) * p) / 1000;
+  *y = t->fromy + ((t->toy - t->fromy) * p) / 1000;
+}
+
+
+int anim_getframe(struct anim_tween *t, long now, int framecount) {
+  int res = (progress(t, now) * framecount) / 1000;
+  if (res >= framecount) res = framecount - 1;
+  return(res);
+}
+
+
+int anim_update(struct anim *a, long now, struct anim_tween *event) {
+  struct anim_tween *t;
+  int i;
+  for (i = 0; i < ANIM_MAXTWEENS; i++) {
+    t = &(a->tween[i]);
+    if ((t->kind == 0) || (now < t->start)) continue;
+    memcpy(event, t, sizeof(struct anim_tween));
+    if (t->started == 0) {
+      t->started = 1;
+      return(ANIM_STARTED);
+    }
+    if (now >= t->start + t->duration) {
+      t->kind = 0;
+      return(ANIM_FINISHED);
+    }
+  }
+  return(ANIM_NONE);
+}
@@ -0,0 +1,62 @@
+/*
+ * This file is part of the Atomiks project
+ * Copyright (C) Mateusz Viste 2013, 2014, 2015
+ *
+ * A tiny animation scheduler: tweens that move something across the screen
+ * over a given time, advanced by the main loop once per frame instead of
+ * blocking it.
+ */
+
+#ifndef anim_h_sentinel
+#define anim_h_sentinel
+
+  #define ANIM_MAXTWEENS 64
+
+  /* events returned by anim_update() */
+  #define ANIM_NONE 0
+  #define ANIM_STARTED 1
+  #define ANIM_FINISHED 2
+
+  struct anim_tween {
+    int kind;          /* what is animated, as defined by the caller. 0 for a free slot */
+    int started;       /* set once the ANIM_STARTED event has been reported */
+    long start;        /* tick at which the tween starts */
+    long duration;     /* miliseconds */
+    int fromx;         /* the tween goes from (fromx,fromy) to (tox,toy) */
+    int fromy;
+    int tox;
+    int toy;
+    int data[6];       /* free for the caller */
+  };
+
+  struct anim {
+    struct anim_tween tween[ANIM_MAXTWEENS];
+  };
+
+  /* drops all tweens, without reporting any event */
+  void anim_clear(struct anim *a);
+
+  /* schedules a new tween. returns it, or NULL if there is no room left */
+  struct anim_tween *anim_add(struct anim *a, int kind, long start, long duration, int fromx, int fromy, int tox, int toy);
+
+  /* returns the first pending tween of a given kind, or NULL if none */
+  struct anim_tween *anim_find(struct anim *a, int kind);
+
+  /* returns non-zero if any tween is pending */
+  int anim_busy(struct anim *a);
+
+  /* makes a tween end right now */
+  void anim_skip(struct anim_tween *t, long now);
+
+  /* computes where a tween is at a given time */
+  void anim_getpos(struct anim_tween *t, long now, int *x, int *y);
+
+  /* returns which of framecount frames a tween is at, at a given time */
+  int anim_getframe(struct anim_tween *t, long now, int framecount);
+
+  /* reports the next tween that started or finished by now, copying it into
+   * *event. finished tweens are removed. returns ANIM_NONE once there is no
+   * event left, so it is meant to be called in a loop */
+  int anim_update(struct anim *a, long now, struct anim_tween *event);
+
+#endif
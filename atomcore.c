@@ -20,63 +20,418 @@
 
 #include <stdlib.h>  /* malloc(), NULL */
 #include <stdio.h>  /* sprintf(), FILE */
+#include <string.h> /* strlen(), strcpy(), memmove() */
 #include <time.h>
 #include "atomcore.h"
 #include "levels.h"
 
+static unsigned long long zobrist[64][256]; /* one key for every atom index on every cell of the 16x16 play area */
+static int zobrist_ready = 0;
+static char leveldir[256] = "lev"; /* where atomix_loadgame() looks for level files */
+
+
+/* fills the zobrist table with pseudo-random keys. The sequence is seeded
+ * with a constant, so hashes are the same from one run to another. */
+static void zobrist_init(void) {
+  unsigned long long seed = 0x41544F4D494B53ULL; /* splitmix64 */
+  unsigned long long z;
+  int i, j;
+  for (i = 0; i < 64; i++) {
+    for (j = 0; j < 256; j++) {
+      seed += 0x9E3779B97F4A7C15ULL;
+      z = seed;
+      z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+      z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+      zobrist[i][j] = z ^ (z >> 31);
+    }
+  }
+  zobrist_ready = 1;
+}
+
+
 /* allocate a new game structure, and fill it with empty spaces */
 struct atomixgame *atomix_initgame(void) {
   struct atomixgame *game;
+  if (zobrist_ready == 0) zobrist_init();
   game = malloc(sizeof(struct atomixgame));
   return(game);
 }
 
 
+/* returns the zobrist key of an atom (a field value) standing at x/y */
+unsigned long long atomix_zobristkey(unsigned char atom, int x, int y) {
+  return(zobrist[atom & field_index][(y << 4) | x]);
+}
+
+
+/* recomputes the hash of the game from scratch */
+unsigned long long atomix_computehash(struct atomixgame *game) {
+  unsigned long long res = 0;
+  int x, y;
+  for (y = 0; y < 16; y++) {
+    for (x = 0; x < 16; x++) {
+      if ((game->field[x][y] & field_type) == field_atom) res ^= atomix_zobristkey(game->field[x][y], x, y);
+    }
+  }
+  return(res);
+}
+
+
+/* returns the index of the lowest set bit of a non-zero value */
+static int lowestbit(unsigned int x) {
+#ifdef __GNUC__
+  return(__builtin_ctz(x));
+#else
+  int res = 0;
+  while ((x & 1) == 0) {
+    x >>= 1;
+    res++;
+  }
+  return(res);
+#endif
+}
+
+
+/* returns the index of the highest set bit of a non-zero value */
+static int highestbit(unsigned int x) {
+#ifdef __GNUC__
+  return((sizeof(unsigned int) * 8 - 1) - __builtin_clz(x));
+#else
+  int res = 0;
+  while (x >>= 1) res++;
+  return(res);
+#endif
+}
+
+
+/* returns how far an atom at position 'pos' slides along a line of 16 cells,
+ * 'line' being the mask of occupied cells of this line. positive directions
+ * go towards higher bits. The board's border acts as an obstacle. */
+static int slidedistance(unsigned int line, int pos, int positive) {
+  if (positive != 0) return(lowestbit((line | 0x10000u) >> (pos + 1)));
+  return(pos - highestbit(((line << 1) | 1u) & ((2u << pos) - 1)));
+}
+
+
+/* rebuilds the index of atoms, the obstacles of rows and columns and the molecule from the playfield and the solution */
+void atomix_buildindex(struct atomixgame *game) {
+  int x, y, i, k;
+  /* mark obstacles (anything but free space) of every row and column */
+  for (k = 0; k < 16; k++) {
+    game->rowstop[k] = 0;
+    game->colstop[k] = 0;
+  }
+  for (y = 0; y < 16; y++) {
+    for (x = 0; x < 16; x++) {
+      if ((game->field[x][y] & field_type) == field_free) continue;
+      game->rowstop[y] |= 1 << x;
+      game->colstop[x] |= 1 << y;
+    }
+  }
+  /* count atoms of every kind */
+  game->atomcount = 0;
+  for (k = 0; k < 64; k++) game->kindlen[k] = 0;
+  for (y = 0; y < 16; y++) {
+    for (x = 0; x < 16; x++) {
+      if ((game->field[x][y] & field_type) != field_atom) continue;
+      game->kindlen[game->field[x][y] & field_index] += 1;
+      game->atomcount += 1;
+    }
+  }
+  /* list the position of atoms, grouped by kind */
+  if (game->atomcount > ATOMIX_MAXATOMS) {
+      game->atomcount = -1;
+    } else {
+      i = 0;
+      for (k = 0; k < 64; k++) {
+        game->kindfirst[k] = i;
+        i += game->kindlen[k];
+        game->kindlen[k] = 0;
+      }
+      for (y = 0; y < 16; y++) {
+        for (x = 0; x < 16; x++) {
+          if ((game->field[x][y] & field_type) != field_atom) continue;
+          k = game->field[x][y] & field_index;
+          game->atomcell[game->kindfirst[k] + game->kindlen[k]] = (y << 4) | x;
+          game->kindlen[k] += 1;
+        }
+      }
+  }
+  /* list the atoms of the molecule, and pick the one with the fewest lookalikes as anchor */
+  game->moleculelen = 0;
+  game->anchor = 0;
+  for (y = 0; y < 16; y++) {
+    for (x = 0; x < 16; x++) {
+      if ((game->solution[x][y] & field_type) != field_atom) continue;
+      if (game->moleculelen == ATOMIX_MAXATOMS) {
+        game->moleculelen = -1;
+        return;
+      }
+      game->moleculeatom[game->moleculelen] = game->solution[x][y];
+      game->moleculecell[game->moleculelen] = (y << 4) | x;
+      if (game->kindlen[game->solution[x][y] & field_index] < game->kindlen[game->moleculeatom[game->anchor] & field_index]) game->anchor = game->moleculelen;
+      game->moleculelen += 1;
+    }
+  }
+}
+
+
+/* finds the index entry of the atom of kind k at a given cell */
+static unsigned char *findatom(struct atomixgame *game, int k, int cell) {
+  int i;
+  for (i = game->kindfirst[k]; i < game->kindfirst[k] + game->kindlen[k]; i++) {
+    if (game->atomcell[i] == cell) return(&(game->atomcell[i]));
+  }
+  return(NULL);
+}
+
+
+/* removes the atom at x/y from the playfield, leaving free space behind. returns the atom */
+unsigned char atomix_pickatom(struct atomixgame *game, int x, int y) {
+  unsigned char atom, *entry;
+  atom = game->field[x][y];
+  game->field[x][y] = field_free;
+  game->hash ^= atomix_zobristkey(atom, x, y);
+  game->rowstop[y] &= ~(1 << x);
+  game->colstop[x] &= ~(1 << y);
+  if (game->atomcount >= 0) {
+    entry = findatom(game, atom & field_index, (y << 4) | x);
+    if (entry != NULL) *entry = ATOMIX_NOCELL;
+  }
+  return(atom);
+}
+
+
+/* puts an atom on the playfield at x/y */
+void atomix_placeatom(struct atomixgame *game, int x, int y, unsigned char atom) {
+  unsigned char *entry;
+  game->field[x][y] = atom;
+  game->hash ^= atomix_zobristkey(atom, x, y);
+  game->rowstop[y] |= 1 << x;
+  game->colstop[x] |= 1 << y;
+  if (game->atomcount >= 0) {
+    entry = findatom(game, atom & field_index, ATOMIX_NOCELL);
+    if (entry != NULL) {
+        *entry = (y << 4) | x;
+      } else { /* an atom that wasn't there before */
+        atomix_buildindex(game);
+    }
+  }
+}
+
+
+/* writes the packed state of the game into packed: the cell of every atom, in
+ * the order of the index, sorted within every kind. returns the number of
+ * bytes written, or -1 if the atoms are not indexed or one of them is off the
+ * playfield */
+int atomix_packstate(struct atomixgame *game, unsigned char *packed) {
+  int i, j, k, end;
+  unsigned char cell;
+  if (game->atomcount < 0) return(-1);
+  for (k = 0; k < 64; k++) {
+    end = game->kindfirst[k] + game->kindlen[k];
+    for (i = game->kindfirst[k]; i < end; i++) {
+      cell = game->atomcell[i];
+      if (cell == ATOMIX_NOCELL) return(-1);
+      for (j = i; (j > game->kindfirst[k]) && (packed[j - 1] > cell); j--) packed[j] = packed[j - 1];
+      packed[j] = cell;
+    }
+  }
+  return(game->atomcount);
+}
+
+
+/* moves the atoms of the game to the positions of a packed state, which must
+ * have been packed from the same level */
+void atomix_unpackstate(struct atomixgame *game, unsigned char *packed) {
+  unsigned char atom;
+  int i, k, end;
+  if (game->atomcount < 0) return;
+  /* take all atoms off the playfield, then put them back where the packed state says */
+  for (i = 0; i < game->atomcount; i++) {
+    if (game->atomcell[i] == ATOMIX_NOCELL) continue;
+    atomix_pickatom(game, game->atomcell[i] & 15, game->atomcell[i] >> 4);
+  }
+  for (k = 0; k < 64; k++) {
+    atom = field_atom | k;
+    end = game->kindfirst[k] + game->kindlen[k];
+    for (i = game->kindfirst[k]; i < end; i++) atomix_placeatom(game, packed[i] & 15, packed[i] >> 4, atom);
+  }
+}
+
+
 /* returns the distance that the block at position x/y would travel if pushed into 'direction'. direction is 0: up / 1: right / 2: down / 3: left */
 int atomix_getmovedistance(struct atomixgame *game, int direction) {
-  int i, x, y;
+  int x, y;
   x = game->cursorx;
   y = game->cursory;
   if ((game->field[x][y] & field_type) != field_atom) return(0); /* non-atoms don't move at all */
-  /* UP */
-  if (direction == 0) {
-    y -= 1;
-    for (i = y; i >= 0; i--) {
-      if ((game->field[x][i] & field_type) != field_free) break;
-    }
-    return(y - i);
+  switch (direction) {
+    case 0: /* UP */
+      return(slidedistance(game->colstop[x], y, 0));
+    case 1: /* RIGHT */
+      return(slidedistance(game->rowstop[y], x, 1));
+    case 2: /* DOWN */
+      return(slidedistance(game->colstop[x], y, 1));
+    case 3: /* LEFT */
+      return(slidedistance(game->rowstop[y], x, 0));
   }
-  /* RIGHT */
-  if (direction == 1) {
-    x += 1;
-    for (i = x; i < 16; i++) {
-      if ((game->field[i][y] & field_type) != field_free) break;
-    }
-    return(i - x);
+  /* if direction is invalid, don't move */
+  return(0);
+}
+
+
+/* fills dest with the cell (y * 16 + x) the atom at x/y would land on when
+ * pushed up, right, down and left. A direction the atom can't move to gives
+ * its own cell. returns the number of directions the atom can move to */
+int atomix_getdestinations(struct atomixgame *game, int x, int y, unsigned char *dest) {
+  int res = 0, cell = (y << 4) | x;
+  if ((game->field[x][y] & field_type) != field_atom) {
+    dest[0] = dest[1] = dest[2] = dest[3] = cell;
+    return(0);
   }
-  /* DOWN */
-  if (direction == 2) {
-    y += 1;
-    for (i = y; i < 16; i++) {
-      if ((game->field[x][i] & field_type) != field_free) break;
+  dest[0] = cell - (slidedistance(game->colstop[x], y, 0) << 4);
+  dest[1] = cell + slidedistance(game->rowstop[y], x, 1);
+  dest[2] = cell + (slidedistance(game->colstop[x], y, 1) << 4);
+  dest[3] = cell - slidedistance(game->rowstop[y], x, 0);
+  for (x = 0; x < 4; x++) if (dest[x] != cell) res++;
+  return(res);
+}
+
+
+/* moves the atom at x/y as far as it goes in direction, and records the move in the journal. returns the distance traveled */
+int atomix_playmove(struct atomixgame *game, int x, int y, int direction, int scoredelta) {
+  static const int dirstep[4] = {-16, 1, 16, -1};
+  unsigned char dest[4], atom;
+  if (atomix_getdestinations(game, x, y, dest) == 0) return(0);
+  if ((direction < 0) || (direction > 3) || (dest[direction] == ((y << 4) | x))) return(0);
+  atom = atomix_pickatom(game, x, y);
+  atomix_placeatom(game, dest[direction] & 15, dest[direction] >> 4, atom);
+  atomix_journal_push(game, atom, (y << 4) | x, dest[direction], scoredelta);
+  return((dest[direction] - ((y << 4) | x)) / dirstep[direction]);
+}
+
+
+/* records a move into the journal, forgetting the moves that could be redone */
+void atomix_journal_push(struct atomixgame *game, unsigned char atom, int from, int to, int scoredelta) {
+  struct atomix_journalentry *entry;
+  game->journallen = game->journalpos;
+  /* when full, forget the oldest half at once, so pushing stays O(1) amortized */
+  if (game->journallen == ATOMIX_MAXJOURNAL) {
+    memmove(game->journal, game->journal + ATOMIX_MAXJOURNAL / 2, (ATOMIX_MAXJOURNAL / 2) * sizeof(struct atomix_journalentry));
+    game->journallen = ATOMIX_MAXJOURNAL / 2;
+  }
+  entry = &(game->journal[game->journallen]);
+  entry->atom = atom;
+  entry->from = from;
+  entry->to = to;
+  entry->scoredelta = scoredelta;
+  game->journallen += 1;
+  game->journalpos = game->journallen;
+}
+
+
+/* takes back the last move. returns the move undone, or NULL if there is nothing to undo */
+struct atomix_journalentry *atomix_undo(struct atomixgame *game) {
+  struct atomix_journalentry *entry;
+  if (game->journalpos == 0) return(NULL);
+  entry = &(game->journal[game->journalpos - 1]);
+  atomix_pickatom(game, entry->to & 15, entry->to >> 4);
+  atomix_placeatom(game, entry->from & 15, entry->from >> 4, entry->atom);
+  game->score -= entry->scoredelta;
+  game->journalpos -= 1;
+  return(entry);
+}
+
+
+/* plays again the last move undone. returns the move, or NULL if there is nothing to redo */
+struct atomix_journalentry *atomix_redo(struct atomixgame *game) {
+  struct atomix_journalentry *entry;
+  if (game->journalpos == game->journallen) return(NULL);
+  entry = &(game->journal[game->journalpos]);
+  atomix_pickatom(game, entry->from & 15, entry->from >> 4);
+  atomix_placeatom(game, entry->to & 15, entry->to >> 4, entry->atom);
+  game->score += entry->scoredelta;
+  game->journalpos += 1;
+  return(entry);
+}
+
+
+/* builds the bitboard view of the game's 16x16 play area */
+void atomix_tobitboard(struct atomixgame *game, struct atomix_bitboard *bb) {
+  int x, y;
+  for (x = 0; x < 16; x++) {
+    bb->walls[x] = 0;
+    bb->atoms[x] = 0;
+    bb->wallscol[x] = 0;
+    bb->atomscol[x] = 0;
+  }
+  for (y = 0; y < 16; y++) {
+    for (x = 0; x < 16; x++) {
+      bb->cell[y * 16 + x] = game->field[x][y];
+      if ((game->field[x][y] & field_type) == field_atom) {
+          bb->atoms[y] |= 1 << x;
+          bb->atomscol[x] |= 1 << y;
+        } else if ((game->field[x][y] & field_type) != field_free) {
+          bb->walls[y] |= 1 << x;
+          bb->wallscol[x] |= 1 << y;
+      }
     }
-    return(i - y);
   }
-  /* LEFT */
-  if (direction == 3) {
-    x -= 1;
-    for (i = x; i >= 0; i--) {
-      if ((game->field[i][y] & field_type) != field_free) break;
+}
+
+
+/* writes a bitboard back into the game's 16x16 play area */
+void atomix_frombitboard(struct atomix_bitboard *bb, struct atomixgame *game) {
+  int x, y;
+  for (y = 0; y < 16; y++) {
+    for (x = 0; x < 16; x++) {
+      game->field[x][y] = bb->cell[y * 16 + x];
     }
-    return(x - i);
+  }
+  game->hash = atomix_computehash(game);
+  atomix_buildindex(game);
+}
+
+
+/* same as atomix_getmovedistance(), but for the atom at x/y on a bitboard */
+int atomix_bitboard_movedistance(struct atomix_bitboard *bb, int x, int y, int direction) {
+  if (((bb->atoms[y] >> x) & 1) == 0) return(0); /* non-atoms don't move at all */
+  switch (direction) {
+    case 0: /* UP */
+      return(slidedistance(bb->wallscol[x] | bb->atomscol[x], y, 0));
+    case 1: /* RIGHT */
+      return(slidedistance(bb->walls[y] | bb->atoms[y], x, 1));
+    case 2: /* DOWN */
+      return(slidedistance(bb->wallscol[x] | bb->atomscol[x], y, 1));
+    case 3: /* LEFT */
+      return(slidedistance(bb->walls[y] | bb->atoms[y], x, 0));
   }
   /* if direction is invalid, don't move */
   return(0);
 }
 
 
-void atomix_loadgame(struct atomixgame *game, int level, int source, int *hiscores) {
-  char levelfile[128];
+/* moves the atom at x_from/y_from to x_to/y_to on a bitboard, leaving free space behind it */
+void atomix_bitboard_moveatom(struct atomix_bitboard *bb, int x_from, int y_from, int x_to, int y_to) {
+  bb->atoms[y_from] &= ~(1 << x_from);
+  bb->atomscol[x_from] &= ~(1 << y_from);
+  bb->atoms[y_to] |= 1 << x_to;
+  bb->atomscol[x_to] |= 1 << y_to;
+  bb->cell[y_to * 16 + x_to] = bb->cell[y_from * 16 + x_from];
+  bb->cell[y_from * 16 + x_from] = field_free;
+}
+
+
+/* sets the directory level files are loaded from, when using ATOMIX_SRC_FILE */
+void atomix_setleveldir(const char *dir) {
+  if (strlen(dir) >= sizeof(leveldir)) return;
+  strcpy(leveldir, dir);
+}
+
+
+int atomix_loadgame(struct atomixgame *game, int level, int source, int *hiscores) {
+  char levelfile[sizeof(leveldir) + 16];
   int x, y, z;
   unsigned char *memptr;
   FILE *fd;
@@ -95,18 +450,29 @@ void atomix_loadgame(struct atomixgame *game, int level, int source, int *hiscor
   game->level_desc_line2[0] = 0;
   game->bg = 0;
   game->score = 500;
+  game->hash = 0;
+  game->journallen = 0;
+  game->journalpos = 0;
   if (hiscores != NULL) {
       game->hiscore = hiscores[level - 1];
     } else {
       game->hiscore = 0;
   }
   if (source == ATOMIX_SRC_FILE) {
-      sprintf(levelfile, "lev/lev%04d.dat", level);
+      sprintf(levelfile, "%s/lev%04d.dat", leveldir, level);
       fd = fopen(levelfile, "rb");
-      if (fd == NULL) return;
+      if (fd == NULL) return(-1);
       memptr = malloc(4096);
-      fread(memptr, 4096, 1, fd);
+      if (memptr == NULL) {
+        fclose(fd);
+        return(-1);
+      }
+      x = fread(memptr, 1, 4096, fd);
       fclose(fd);
+      if (x < 546) { /* 2 fields, the duration, 2 descriptions, the cursor type and the bg */
+        free(memptr);
+        return(-1);
+      }
     } else {
       switch (level) {
         case 1:
@@ -200,7 +566,7 @@ void atomix_loadgame(struct atomixgame *game, int level, int source, int *hiscor
           memptr = lev_lev0030_dat;
           break;
         default:
-          return;
+          return(-1);
       }
   }
   /* read initial playfield */
@@ -257,14 +623,17 @@ void atomix_loadgame(struct atomixgame *game, int level, int source, int *hiscor
       }
     }
   }
+  /* compute the hash of the initial position, and index the atoms */
+  game->hash = atomix_computehash(game);
+  atomix_buildindex(game);
   if (source == ATOMIX_SRC_FILE) free(memptr);
+  return(0);
 }
 
 
-/* compares two games - the first is the playfield and the second is the expected solution. Returns 0 if game is not done, non-zero otherwise. */
-int atomix_checksolution(struct atomixgame *game) {
+/* brute force version of atomix_checksolution(), trying every possible placement of the solution */
+static int checksolution_scan(struct atomixgame *game) {
   int x, y, xx, yy, win;
-  if ((game->solution_width == 0) || (game->field_width == 0)) return(0); /* no solution is possible */
   for (x = 0; x <= game->field_width - game->solution_width; x++) {
     for (y = 0; y <= game->field_height - game->solution_height; y++) {
       win = 1; /* assume we are in a win position */
@@ -284,3 +653,25 @@ int atomix_checksolution(struct atomixgame *game) {
   }
   return(0);
 }
+
+
+/* compares two games - the first is the playfield and the second is the expected solution. Returns 0 if game is not done, non-zero otherwise. */
+int atomix_checksolution(struct atomixgame *game) {
+  int i, j, k, ox, oy, cell;
+  if ((game->solution_width == 0) || (game->field_width == 0)) return(0); /* no solution is possible */
+  if ((game->atomcount < 0) || (game->moleculelen <= 0)) return(checksolution_scan(game));
+  /* the molecule can only be assembled around an atom matching its anchor */
+  k = game->moleculeatom[game->anchor] & field_index;
+  for (i = game->kindfirst[k]; i < game->kindfirst[k] + game->kindlen[k]; i++) {
+    if (game->atomcell[i] == ATOMIX_NOCELL) continue;
+    ox = (game->atomcell[i] & 15) - (game->moleculecell[game->anchor] & 15);
+    oy = (game->atomcell[i] >> 4) - (game->moleculecell[game->anchor] >> 4);
+    if ((ox < 0) || (oy < 0) || (ox > game->field_width - game->solution_width) || (oy > game->field_height - game->solution_height)) continue;
+    for (j = 0; j < game->moleculelen; j++) {
+      cell = game->moleculecell[j];
+      if (game->field[ox + (cell & 15)][oy + (cell >> 4)] != game->moleculeatom[j]) break;
+    }
+    if (j == game->moleculelen) return(1);
+  }
+  return(0);
+}
@@ -27,9 +27,21 @@
   #define field_type 192
   #define field_index 63
 
+  #define ATOMIX_MAXATOMS 64  /* max number of atoms the game keeps an index of */
+  #define ATOMIX_NOCELL 255   /* position of an atom that is not on the playfield */
+  #define ATOMIX_MAXJOURNAL 1024  /* max number of moves the journal remembers */
+
   #define ATOMIX_SRC_FILE 1
   #define ATOMIX_SRC_MEM 2
 
+  /* a move, as remembered by the journal */
+  struct atomix_journalentry {
+    unsigned char atom;       /* field value of the moved atom */
+    unsigned char from;       /* cell (y * 16 + x) the atom left */
+    unsigned char to;         /* cell (y * 16 + x) the atom landed on */
+    signed char scoredelta;   /* change of the score caused by the move */
+  };
+
   struct atomixgame {
     unsigned char field_width;
     unsigned char field_height;
@@ -51,15 +63,108 @@
     int bg;
     int score;
     int hiscore;
+    unsigned long long hash;  /* zobrist hash of the atoms' positions, kept up to date by atomix_pickatom() and atomix_placeatom() */
+    /* index of atoms, kept up to date by atomix_pickatom() and atomix_placeatom() */
+    int atomcount;                               /* number of indexed atoms, -1 if there are too many of them */
+    unsigned char atomcell[ATOMIX_MAXATOMS];     /* position (y * 16 + x) of every atom, grouped by atom index */
+    unsigned char kindfirst[64];                 /* first entry of atomcell[] for every atom index */
+    unsigned char kindlen[64];                   /* number of entries of atomcell[] for every atom index */
+    /* the molecule, as a list of atoms relative to the solution's corner */
+    int moleculelen;
+    unsigned char moleculeatom[ATOMIX_MAXATOMS]; /* field value of every atom of the molecule */
+    unsigned char moleculecell[ATOMIX_MAXATOMS]; /* position (y * 16 + x) of every atom of the molecule */
+    int anchor;                                  /* atom of the molecule whose kind is the rarest on the playfield */
+    /* obstacles met by sliding atoms, kept up to date by atomix_pickatom() and atomix_placeatom() */
+    unsigned short rowstop[16];                  /* anything but free space, by row (bit n being x = n) */
+    unsigned short colstop[16];                  /* same, by column (bit n being y = n) */
+    /* journal of moves, for undo and redo */
+    struct atomix_journalentry journal[ATOMIX_MAXJOURNAL];
+    int journallen;                              /* number of moves in the journal */
+    int journalpos;                              /* number of moves played - the ones after it can be redone */
+  };
+
+  /* bitboard view of the 16x16 play area. Every array is a 256-bit mask made
+   * of 16 rows (or columns) of 16 bits, bit n being the cell at x = n (or y = n) */
+  struct atomix_bitboard {
+    unsigned short walls[16];     /* cells an atom can never enter (walls and void), by row */
+    unsigned short atoms[16];     /* cells holding an atom, by row */
+    unsigned short wallscol[16];  /* same as walls, by column */
+    unsigned short atomscol[16];  /* same as atoms, by column */
+    unsigned char cell[256];      /* the original field bytes (y * 16 + x), so conversions are lossless */
   };
 
   struct atomixgame *atomix_initgame(void);
 
-  void atomix_loadgame(struct atomixgame *game, int level, int source, int *hiscores);
+  /* sets the directory level files are loaded from when using ATOMIX_SRC_FILE ("lev" by default) */
+  void atomix_setleveldir(const char *dir);
+
+  /* loads a level into game. returns 0 on success, non-zero if the level file could not be read */
+  int atomix_loadgame(struct atomixgame *game, int level, int source, int *hiscores);
+
+  /* returns the zobrist key of an atom (a field value) standing at x/y. xor-ing
+   * together the keys of all atoms gives the hash of a game state */
+  unsigned long long atomix_zobristkey(unsigned char atom, int x, int y);
+
+  /* recomputes the hash of the game from scratch */
+  unsigned long long atomix_computehash(struct atomixgame *game);
+
+  /* rebuilds the index of atoms, the obstacles of rows and columns and the
+   * molecule from the playfield and the solution. must be called after
+   * modifying game->field directly */
+  void atomix_buildindex(struct atomixgame *game);
+
+  /* removes the atom at x/y from the playfield, leaving free space behind. returns the atom */
+  unsigned char atomix_pickatom(struct atomixgame *game, int x, int y);
+
+  /* puts an atom on the playfield at x/y */
+  void atomix_placeatom(struct atomixgame *game, int x, int y, unsigned char atom);
+
+  /* a packed state is the position of the atoms alone, on game->atomcount
+   * bytes: the cell (y * 16 + x) of every atom, grouped by kind like the index
+   * of atoms and sorted within every kind. Walls never move, so this is all a
+   * search needs to tell states apart, and states that only differ by swapping
+   * two identical atoms pack to the same bytes */
+  int atomix_packstate(struct atomixgame *game, unsigned char *packed);
+
+  /* moves the atoms of the game to the positions of a packed state of the same level */
+  void atomix_unpackstate(struct atomixgame *game, unsigned char *packed);
 
   /* returns the distance that the block at position x/y would travel if pushed into 'direction'. direction is 0: up / 1: right / 2: down / 3: left */
   int atomix_getmovedistance(struct atomixgame *game, int direction);
 
+  /* fills dest[4] with the cell (y * 16 + x) the atom at x/y lands on when pushed
+   * up, right, down and left (its own cell if it can't move that way). returns
+   * the number of directions the atom can move to */
+  int atomix_getdestinations(struct atomixgame *game, int x, int y, unsigned char *dest);
+
+  /* moves the atom at x/y as far as it goes in direction (0: up / 1: right /
+   * 2: down / 3: left), and records the move in the journal. returns the
+   * distance traveled (0 if the atom could not move) */
+  int atomix_playmove(struct atomixgame *game, int x, int y, int direction, int scoredelta);
+
+  /* records a move that has been made on the playfield into the journal,
+   * forgetting the moves that could be redone */
+  void atomix_journal_push(struct atomixgame *game, unsigned char atom, int from, int to, int scoredelta);
+
+  /* takes back the last move, putting the atom back where it was and restoring
+   * the score. returns the move undone, or NULL if there is nothing to undo */
+  struct atomix_journalentry *atomix_undo(struct atomixgame *game);
+
+  /* plays again the last move undone. returns the move, or NULL if there is nothing to redo */
+  struct atomix_journalentry *atomix_redo(struct atomixgame *game);
+
+  /* builds the bitboard view of the game's 16x16 play area */
+  void atomix_tobitboard(struct atomixgame *game, struct atomix_bitboard *bb);
+
+  /* writes a bitboard back into the game's 16x16 play area */
+  void atomix_frombitboard(struct atomix_bitboard *bb, struct atomixgame *game);
+
+  /* same as atomix_getmovedistance(), but for the atom at x/y on a bitboard */
+  int atomix_bitboard_movedistance(struct atomix_bitboard *bb, int x, int y, int direction);
+
+  /* moves the atom at x_from/y_from to x_to/y_to on a bitboard, leaving free space behind it */
+  void atomix_bitboard_moveatom(struct atomix_bitboard *bb, int x_from, int y_from, int x_to, int y_to);
+
   /* compares two games - the first is the playfield and the second is the expected solution. Returns 0 if game is not done, non-zero otherwise. */
   int atomix_checksolution(struct atomixgame *game);
 
@@ -22,6 +22,11 @@
 #include <time.h>
 
 #include "atomcore.h"
+#include "atomsolve.h"
+#include "hint.h"
+#include "anim.h"
+#include "prof.h"
+#include "pack.h"
 #include "data.h"
 #include "gz.h"
 #include "cfg.h"
@@ -37,6 +42,26 @@
 #define TILESIZE 16  /* the TILESIZE is the elementary unit of measurement */
                      /* in the game. */
 
+/* kinds of animations */
+#define ANIM_SLIDE 1      /* an atom sliding: data is atom, from, to, scoredelta and sound channel */
+#define ANIM_CURSOR 2     /* the cursor moving to a neighbour cell */
+#define ANIM_EXPLOSION 3  /* an atom exploding at the end of the level: data is its x/y position */
+
+#define SLIDE_SPEED 7         /* miliseconds per pixel travelled by a sliding atom */
+#define CURSOR_DURATION 40    /* miliseconds for the cursor to move by one cell */
+#define EXPLOSION_DURATION 320
+#define EXPLOSION_INTERVAL 470  /* miliseconds between the start of two explosions */
+
+#define LOGIC_STEP 10         /* the game logic runs every 10 ms of game time */
+#define FRAME_US 16667        /* frame duration when the display does not pace us (60 fps) */
+
+/* the data and length of an asset, from the asset pack if it has it, or else
+ * from data.h. both are arguments of the loaders, hence the macro */
+#define ASSET(a) pack_get(#a, a), pack_getlen(#a, a##_len)
+
+#define BENCH_FRAME 16          /* game time between two frames of the benchmark, in ms */
+#define BENCH_MAXNODES 200000   /* search limit of the benchmark solver, to keep it short */
+
 
 struct spritesstruct {
   struct gra_sprite *atom[49];
@@ -63,17 +88,15 @@ struct soundsstruct {
 };
 
 
-struct loosetile_t {
-  int atom;
-  int x;
-  int y;
-  int origpos_x;
-  int origpos_y;
-};
+static int profoverlay = 0;  /* show profiling stats on the game screen */
 
 
 static enum atomiks_keys pollkey(void) {
-  return(inp_waitkey(-1));
+  enum atomiks_keys res;
+  prof_begin(PROF_INPUT);
+  res = inp_waitkey(-1);
+  prof_end(PROF_INPUT);
+  return(res);
 }
 
 
@@ -134,11 +157,13 @@ static void draw_playfield_tile(struct atomixgame *game, int x, int y, struct sp
 }
 
 
-static void draw_anim_explosions(struct atomixgame *game, struct spritesstruct *sprites, struct soundsstruct *sounds) {
+/* schedules the explosion of all atoms on the playfield, one after another in a random order */
+static void start_explosions(struct atomixgame *game, struct anim *anims, long now) {
   int listlen = 0;
   int listx[64];
   int listy[64];
   int i, x, y;
+  struct anim_tween *t;
   /* compute the list of atoms on the playfield */
   for (y = 0; y < game->field_height; y++) {
     for (x = 0; x < game->field_width; x++) {
@@ -164,112 +189,42 @@ static void draw_anim_explosions(struct atomixgame *game, struct spritesstruct *
       }
     }
   }
-  /* animate explosions of atoms */
-  for (x = 0; x < listlen; x++) {
-    if (sounds->soundflag != 0) snd_playwav(sounds->explode, 0);
-    for (i = 0; i < 8; i++) {
-      draw_playfield_tile(game, listx[x], listy[x], sprites, sprites->empty);
-      draw_playfield_tile(game, listx[x], listy[x], sprites, sprites->explosion[i]);
-      gra_refresh();
-      tim_delay(40);
-    }
-    game->field[listx[x]][listy[x]] = field_free; /* update the playfield to mark the area free */
-    draw_playfield_tile(game, listx[x], listy[x], sprites, sprites->empty);
-    gra_refresh();
-    tim_delay(150);
-  }
-}
-
-
-/* moves the cursor up by one place up */
-static void move_cursor_up(struct atomixgame *game, struct spritesstruct *sprites) {
-  int y, x, y1, y2;
-  unsigned long sleepuntilticks;
-  if (game->cursory <= 0) return;
-  if (game->field[game->cursorx][game->cursory - 1] == 0) return;
-  x = game->offseth + (game->cursorx * TILESIZE);
-  y1 = game->offsetv + (game->cursory * TILESIZE);
-  y2 = game->offsetv + ((game->cursory - 1) * TILESIZE);
-  sleepuntilticks = tim_getticks();
-  for (y = y1; y >= y2; y--) {
-    if (y % 4 == 0) {
-      sleepuntilticks += 10;
-      draw_playfield_tile(game, game->cursorx, game->cursory, sprites, NULL);
-      draw_playfield_tile(game, game->cursorx, game->cursory - 1, sprites, NULL);
-      gra_drawsprite(sprites->cursor[0], x, y);
-      gra_refresh();
-      tim_wait_until_tick(sleepuntilticks, NULL);
-    }
+  /* schedule explosions of atoms */
+  for (i = 0; i < listlen; i++) {
+    t = anim_add(anims, ANIM_EXPLOSION, now + i * EXPLOSION_INTERVAL, EXPLOSION_DURATION, 0, 0, 0, 0);
+    if (t == NULL) break;
+    t->data[0] = listx[i];
+    t->data[1] = listy[i];
   }
-  game->cursory -= 1;
 }
 
 
-/* moves the cursor by one place right */
-static void move_cursor_right(struct atomixgame *game, struct spritesstruct *sprites) {
-  int y, x, x1, x2;
-  unsigned long sleepuntilticks;
-  if (game->field[game->cursorx + 1][game->cursory] == 0) return;
-  y = game->offsetv + (game->cursory * TILESIZE);
-  x1 = game->offseth + (game->cursorx * TILESIZE);
-  x2 = game->offseth + ((game->cursorx + 1) * TILESIZE);
-  sleepuntilticks = tim_getticks();
-  for (x = x1; x <= x2; x++) {
-    if (x % 4 == 0) {
-      sleepuntilticks += 10;
-      draw_playfield_tile(game, game->cursorx, game->cursory, sprites, NULL);
-      draw_playfield_tile(game, game->cursorx + 1, game->cursory, sprites, NULL);
-      gra_drawsprite(sprites->cursor[0], x, y);
-      gra_refresh();
-      tim_wait_until_tick(sleepuntilticks, NULL);
-    }
-  }
-  game->cursorx += 1;
-}
-
-/* moves the cursor by one place down */
-static void move_cursor_down(struct atomixgame *game, struct spritesstruct *sprites) {
-  int y, x, y1, y2;
-  unsigned long sleepuntilticks;
-  if (game->field[game->cursorx][game->cursory + 1] == 0) return;
-  x = game->offseth + (game->cursorx * TILESIZE);
-  y1 = game->offsetv + (game->cursory * TILESIZE);
-  y2 = game->offsetv + ((game->cursory + 1) * TILESIZE);
-  sleepuntilticks = tim_getticks();
-  for (y = y1; y <= y2; y++) {
-    if (y % 4 == 0) {
-      sleepuntilticks += 10;
-      draw_playfield_tile(game, game->cursorx, game->cursory, sprites, NULL);
-      draw_playfield_tile(game, game->cursorx, game->cursory + 1, sprites, NULL);
-      gra_drawsprite(sprites->cursor[0], x, y);
-      gra_refresh();
-      tim_wait_until_tick(sleepuntilticks, NULL);
-    }
-  }
-  game->cursory += 1;
-}
-
-/* moves the cursor up by one place left */
-static void move_cursor_left(struct atomixgame *game, struct spritesstruct *sprites) {
-  int y, x, x1, x2;
-  unsigned long sleepuntilticks;
-  if (game->cursorx <= 0) return;
-  if (game->field[game->cursorx - 1][game->cursory] == 0) return;
-  y = game->offsetv + (game->cursory * TILESIZE);
-  x1 = game->offseth + (game->cursorx * TILESIZE);
-  x2 = game->offseth + ((game->cursorx - 1) * TILESIZE);
-  sleepuntilticks = tim_getticks();
-  for (x = x1; x >= x2; x--) {
-    if (x % 4 == 0) {
-      sleepuntilticks += 10;
-      draw_playfield_tile(game, game->cursorx, game->cursory, sprites, NULL);
-      draw_playfield_tile(game, game->cursorx - 1, game->cursory, sprites, NULL);
-      gra_drawsprite(sprites->cursor[0], x, y);
-      gra_refresh();
-      tim_wait_until_tick(sleepuntilticks, NULL);
-    }
+/* moves the cursor by one place in a given direction, gliding from wherever
+ * it is displayed right now */
+static void move_cursor(struct atomixgame *game, struct anim *anims, int dx, int dy) {
+  int x, y, fromx, fromy;
+  long now = tim_getticks();
+  struct anim_tween *t;
+  x = game->cursorx + dx;
+  y = game->cursory + dy;
+  if ((x < 0) || (y < 0) || (x >= game->field_width) || (y >= game->field_height)) return;
+  if (game->field[x][y] == 0) return;
+  t = anim_find(anims, ANIM_CURSOR);
+  if (t != NULL) {
+      anim_getpos(t, now, &fromx, &fromy);
+    } else {
+      fromx = game->offseth + (game->cursorx * TILESIZE);
+      fromy = game->offsetv + (game->cursory * TILESIZE);
+      t = anim_add(anims, ANIM_CURSOR, now, CURSOR_DURATION, 0, 0, 0, 0);
   }
-  game->cursorx -= 1;
+  game->cursorx = x;
+  game->cursory = y;
+  if (t == NULL) return; /* no room for the animation, the cursor simply jumps */
+  t->start = now;
+  t->fromx = fromx;
+  t->fromy = fromy;
+  t->tox = game->offseth + (x * TILESIZE);
+  t->toy = game->offsetv + (y * TILESIZE);
 }
 
 
@@ -291,45 +246,64 @@ static void drawstring3(struct spritesstruct *sprites, char *str, int x, int y)
 }
 
 
-static void draw_game_screen(struct atomixgame *game, struct spritesstruct *sprites, int skipcursor, time_t curtime, long curtick, struct loosetile_t *loosetile) {
+/* draws a string with the small font1 glyphs, using a fixed width for all of them */
+static void drawstring1(struct spritesstruct *sprites, char *str, int x, int y) {
+  for (; *str != 0; str++) {
+    gra_drawsprite(sprites->font1[ascii2font1(*str)], x, y);
+    x += 6;
+  }
+}
+
+
+/* draws the profiling stats in the top right corner of the screen */
+static void draw_prof_overlay(struct spritesstruct *sprites) {
+  struct prof_stats stats;
+  struct tim_stats timstats;
+  char line[32];
+  prof_getstats(&stats);
+  tim_getstats(&timstats);
+  gra_drawpartsprite(sprites->black, 0, 0, 110, 30, 210, 0);
+  sprintf(line, "FPS %d", stats.fps);
+  drawstring1(sprites, line, 212, 2);
+  sprintf(line, "P50 %luUS", stats.p50);
+  drawstring1(sprites, line, 212, 9);
+  sprintf(line, "P99 %luUS", stats.p99);
+  drawstring1(sprites, line, 266, 9);
+  sprintf(line, "CALLS %lu TEX %lu", stats.counter[PROF_DRAWCALLS], stats.counter[PROF_TEXSWITCHES]);
+  drawstring1(sprites, line, 212, 16);
+  sprintf(line, "WAIT LATE %lluUS", timstats.maxdrift / 1000);
+  drawstring1(sprites, line, 212, 23);
+}
+
+
+/* returns the vertical position of a row of the side panel (0: hiscore,
+ * 1: score, 2: level, 3: time), either of its label or of its value */
+static int panel_y(struct spritesstruct *sprites, int row, int valueflag) {
+  int lineheight = gra_getspriteheight(sprites->font3[0]) * 1.40;
+  int res = TILESIZE / 2 + row * (lineheight + TILESIZE * 2);
+  if (valueflag != 0) res += lineheight;
+  return(res);
+}
+
+
+/* draws the parts of the game screen that change only when the playfield
+ * does: background, tiles, labels, hiscore and level number */
+static void draw_static_screen(struct atomixgame *game, struct spritesstruct *sprites) {
   int x, y;
   int rect_x, rect_y;
-  struct gra_sprite *tile;
-  unsigned int timeleft = 0;
-  unsigned char font1_width[] = {5,5,4,5,4,4,5,5,2,4,4,4,6,5,5,5,5,5,5,4,5,4,6,4,5,4,5,4,4,4,4,4,5,4,5,5}; /* provides the width of every single glyph in the font1 set */
   char tmpstring[16];
-  gra_clear();  /* first clear out the screen */
   gra_drawsprite(sprites->bg[game->bg], 0, 0);  /* draw background */
-  if (curtime <= game->time_end) {
-    timeleft = game->time_end - curtime;
-  }
   /* Draw the playfield */
   for (y = 0; y < game->field_height; y++) {
     for (x = 0; x < game->field_width; x++) {
       draw_playfield_tile(game, x, y, sprites, NULL);
     }
   }
-  if (loosetile != NULL) {
-    /* if it's a selected atom, draw it first */
-    if (loosetile->atom >= 0) {
-      gra_drawsprite(sprites->empty, loosetile->x, loosetile->y);
-      gra_drawsprite(sprites->atom[loosetile->atom & field_index], loosetile->x, loosetile->y);
-    }
-    /* now draw the cursor */
-    gra_drawsprite(sprites->cursor[game->cursorstate], loosetile->x, loosetile->y);
-  }
-  /* draw the cursor */
-  if (skipcursor == 0) {
-    rect_x = game->offseth + (game->cursorx * gra_getspritewidth(sprites->cursor[0]));
-    rect_y = game->offsetv + (game->cursory * gra_getspriteheight(sprites->cursor[0]));
-    gra_drawsprite(sprites->cursor[game->cursorstate], rect_x, rect_y);
-  }
   /* Draw text ("HISCORE") */
   rect_x = TILESIZE / 2;
-  rect_y = TILESIZE / 2;
-  drawstring3(sprites, "HISCORE", rect_x, rect_y);
+  drawstring3(sprites, "HISCORE", rect_x, panel_y(sprites, 0, 0));
   /* Draw text (actual hiscore) */
-  rect_y += gra_getspriteheight(sprites->font3[0]) * 1.40;
+  rect_y = panel_y(sprites, 0, 1);
   snprintf(tmpstring, 16, "%d", game->hiscore);
   for (x = 0; tmpstring[x] != 0; x++) {
     gra_drawsprite(sprites->font2[(unsigned)tmpstring[x] - '0'], rect_x, rect_y);
@@ -337,31 +311,139 @@ static void draw_game_screen(struct atomixgame *game, struct spritesstruct *spri
   }
   /* Draw text ("SCORE") */
   rect_x = TILESIZE / 2;
-  rect_y += TILESIZE * 2;
-  drawstring3(sprites, "SCORE", rect_x, rect_y);
-  /* Draw text (actual score) */
-  rect_y += gra_getspriteheight(sprites->font3[0]) * 1.40;
-  snprintf(tmpstring, 16, "%d", game->score);
-  for (x = 0; tmpstring[x] != 0; x++) {
-    gra_drawsprite(sprites->font2[(unsigned)tmpstring[x] - '0'], rect_x, rect_y);
-    rect_x += gra_getspritewidth(sprites->font2[0]);
-  }
+  drawstring3(sprites, "SCORE", rect_x, panel_y(sprites, 1, 0));
   /* Draw text ("LEVEL") */
-  rect_x = TILESIZE / 2;
-  rect_y += TILESIZE * 2;
-  drawstring3(sprites, "LEVEL", rect_x, rect_y);
+  drawstring3(sprites, "LEVEL", rect_x, panel_y(sprites, 2, 0));
   /* Draw text (level number) */
-  rect_y += gra_getspriteheight(sprites->font3[0]) * 1.40;
+  rect_y = panel_y(sprites, 2, 1);
   gra_drawsprite(sprites->font2[game->level / 10], rect_x, rect_y);
   rect_x += gra_getspritewidth(sprites->font2[0]);
   gra_drawsprite(sprites->font2[game->level % 10], rect_x, rect_y);
   /* Draw text ("TIME") */
   rect_x = TILESIZE / 2;
-  rect_y += TILESIZE * 2;
-  drawstring3(sprites, "TIME", rect_x, rect_y);
+  drawstring3(sprites, "TIME", rect_x, panel_y(sprites, 3, 0));
+}
+
+
+/* draws the game screen as it is at curtick, along with the hint if hintstatus
+ * is HINT_READY, or a notice if it is HINT_UNAVAILABLE. returns non-zero if
+ * the screen has been updated */
+static int draw_game_screen(struct atomixgame *game, struct spritesstruct *sprites, int skipcursor, time_t curtime, long curtick, struct anim *anims, struct atomix_move *hint, int hintstatus) {
+  int x, y, i;
+  int rect_x, rect_y;
+  struct gra_sprite *tile;
+  struct anim_tween *t;
+  int res;
+  unsigned int timeleft = 0;
+  unsigned char font1_width[] = {5,5,4,5,4,4,5,5,2,4,4,4,6,5,5,5,5,5,5,4,5,4,6,4,5,4,5,4,4,4,4,4,5,4,5,5}; /* provides the width of every single glyph in the font1 set */
+  char tmpstring[16];
+  /* the static part of the screen is kept in a layer, rebuilt only when the
+   * playfield (its hash), the level, the background or the hiscore change */
+  static struct gra_sprite *layer = NULL;
+  static int layerfailed = 0, layerlevel, layerbg, layerhiscore;
+  static unsigned long long layerhash;
+  prof_begin(PROF_DRAWSCREEN);
+  if (curtime <= game->time_end) {
+    timeleft = game->time_end - curtime;
+  }
+  if ((layer == NULL) && (layerfailed == 0)) {
+    layer = gra_createlayer(320, 240);
+    if (layer == NULL) layerfailed = 1;
+    layerlevel = -1;
+  }
+  if ((layerfailed == 0) && ((layerlevel != game->level) || (layerhash != game->hash) || (layerbg != game->bg) || (layerhiscore != game->hiscore))) {
+    if (gra_beginlayer(layer) == 0) {
+        gra_begin_batch();
+        draw_static_screen(game, sprites);
+        gra_end_batch();
+        gra_endlayer();
+        layerlevel = game->level;
+        layerhash = game->hash;
+        layerbg = game->bg;
+        layerhiscore = game->hiscore;
+      } else { /* draw everything directly from now on */
+        gra_endlayer();
+        layerfailed = 1;
+    }
+  }
+  gra_clear();  /* first clear out the screen */
+  gra_begin_batch();  /* queue all the sprites of the screen, so they get drawn in a few calls */
+  if (layerfailed == 0) {
+      gra_drawsprite(layer, 0, 0);
+    } else {
+      draw_static_screen(game, sprites);
+  }
+  /* draw whatever is being animated */
+  for (i = 0; (anims != NULL) && (i < ANIM_MAXTWEENS); i++) {
+    t = &(anims->tween[i]);
+    if ((t->kind == 0) || (curtick < t->start)) continue;
+    switch (t->kind) {
+      case ANIM_SLIDE: /* the moving atom, with the cursor on it */
+        anim_getpos(t, curtick, &rect_x, &rect_y);
+        gra_drawsprite(sprites->empty, rect_x, rect_y);
+        gra_drawsprite(sprites->atom[t->data[0] & field_index], rect_x, rect_y);
+        gra_drawsprite(sprites->cursor[game->cursorstate], rect_x, rect_y);
+        skipcursor = 1;
+        break;
+      case ANIM_CURSOR:
+        anim_getpos(t, curtick, &rect_x, &rect_y);
+        if (skipcursor == 0) gra_drawsprite(sprites->cursor[game->cursorstate], rect_x, rect_y);
+        skipcursor = 1;
+        break;
+      case ANIM_EXPLOSION:
+        draw_playfield_tile(game, t->data[0], t->data[1], sprites, sprites->explosion[anim_getframe(t, curtick, 8)]);
+        break;
+    }
+  }
+  /* draw the cursor */
+  if (skipcursor == 0) {
+    rect_x = game->offseth + (game->cursorx * gra_getspritewidth(sprites->cursor[0]));
+    rect_y = game->offsetv + (game->cursory * gra_getspriteheight(sprites->cursor[0]));
+    gra_drawsprite(sprites->cursor[game->cursorstate], rect_x, rect_y);
+  }
+  /* draw the hint: a selected cursor on the atom to move, and a small copy of the atom where it lands */
+  if (hintstatus == HINT_READY) {
+    x = hint->x;
+    y = hint->y;
+    switch (hint->direction) {
+      case 0:
+        y -= hint->distance;
+        break;
+      case 1:
+        x += hint->distance;
+        break;
+      case 2:
+        y += hint->distance;
+        break;
+      default:
+        x -= hint->distance;
+        break;
+    }
+    rect_x = game->offseth + (hint->x * TILESIZE);
+    rect_y = game->offsetv + (hint->y * TILESIZE);
+    gra_drawsprite(sprites->cursor[1], rect_x, rect_y);
+    rect_x = game->offseth + (x * TILESIZE) + (TILESIZE / 4);
+    rect_y = game->offsetv + (y * TILESIZE) + (TILESIZE / 4);
+    gra_drawsprite(sprites->satom[game->field[hint->x][hint->y] & field_index], rect_x, rect_y);
+  }
+  /* tell the player when the solver gave up, rather than showing nothing at all */
+  if (hintstatus == HINT_UNAVAILABLE) {
+    rect_x = 72 + (320 - 72 - 7 * 6) / 2;
+    rect_y = 240 - 9;
+    gra_drawpartsprite(sprites->black, 0, 0, 7 * 6 + 2, 9, rect_x - 1, rect_y - 1);
+    drawstring1(sprites, "NO HINT", rect_x, rect_y);
+  }
+  /* Draw text (actual score) */
+  rect_x = TILESIZE / 2;
+  rect_y = panel_y(sprites, 1, 1);
+  snprintf(tmpstring, 16, "%d", game->score);
+  for (x = 0; tmpstring[x] != 0; x++) {
+    gra_drawsprite(sprites->font2[(unsigned)tmpstring[x] - '0'], rect_x, rect_y);
+    rect_x += gra_getspritewidth(sprites->font2[0]);
+  }
   /* Draw text (time left) */
   rect_x = TILESIZE / 2;
-  rect_y += gra_getspriteheight(sprites->font3[0]) * 1.40;
+  rect_y = panel_y(sprites, 3, 1);
   gra_drawsprite(sprites->font2[timeleft / 60], rect_x, rect_y);
   rect_x += gra_getspritewidth(sprites->font2[0]);
   gra_drawsprite(sprites->font2[10], rect_x, rect_y);
@@ -412,67 +494,238 @@ static void draw_game_screen(struct atomixgame *game, struct spritesstruct *spri
       }
     }
   }
+  if (profoverlay != 0) draw_prof_overlay(sprites);
   /* Refresh the screen */
-  gra_refresh();
+  gra_end_batch();
+  res = gra_refresh();
+  prof_end(PROF_DRAWSCREEN);
+  return(res);
 }
 
 
-/* moves an atom from one position of the field to another */
-static void move_atom(struct atomixgame *game, int x_from, int y_from, int x_to, int y_to, struct soundsstruct *sounds, struct spritesstruct *sprites) {
-  int x, y, kierunekx = 0, kieruneky = 0, sndchannel;
-  /* int rect_x, rect_y; */
-  struct loosetile_t loosetile;
-  if (x_from > x_to) {
-      kierunekx = -1;
-    } else if (x_from < x_to) {
-      kierunekx = 1;
-    } else if (y_from > y_to) {
-      kieruneky = -1;
-    } else if (y_from < y_to) {
-      kieruneky = 1;
-    } else {  /* we're not moving at all! */
-      return;
-  }
-  x = game->offseth + (x_from * TILESIZE);
-  y = game->offsetv + (y_from * TILESIZE);
-  /* rect_x = 0; */
-  if (sounds->soundflag != 0) {
-      sndchannel = snd_playwav(sounds->bzzz, -1);
-    } else {
-      sndchannel = -1;
-  }
-  /* move the moving tile from the playfield into a loosetile struct */
-  loosetile.origpos_x = x;
-  loosetile.origpos_y = y;
-  loosetile.atom = game->field[x_from][y_from];
-  game->field[x_from][y_from] = field_free;
-  /* draw the moving */
-  for (; y != game->offsetv + (y_to * TILESIZE); y += kieruneky) {
-    /* if (rect_x != 0) gra_drawsprite(empty, rect_x, rect_y); */
-    loosetile.x = x;
-    loosetile.y = y;
-    /* draw the screen */
-    if (y % 3 == 0) {
-      draw_game_screen(game, sprites, 1, time(NULL), tim_getticks(), &loosetile);
-      tim_delay(20);
+/* starts moving an atom from one position of the field to another at tick
+ * 'now'. the atom stays off the playfield until its slide ends */
+static void start_slide(struct atomixgame *game, struct anim *anims, int x_from, int y_from, int x_to, int y_to, int scoredelta, long now, struct soundsstruct *sounds) {
+  struct anim_tween *t;
+  int fromx, fromy, tox, toy, distance, atom;
+  fromx = game->offseth + (x_from * TILESIZE);
+  fromy = game->offsetv + (y_from * TILESIZE);
+  tox = game->offseth + (x_to * TILESIZE);
+  toy = game->offsetv + (y_to * TILESIZE);
+  distance = abs(tox - fromx) + abs(toy - fromy);
+  t = anim_add(anims, ANIM_SLIDE, now, distance * SLIDE_SPEED, fromx, fromy, tox, toy);
+  if (t == NULL) { /* no room for the animation, the atom jumps to its destination */
+    atom = atomix_pickatom(game, x_from, y_from);
+    atomix_placeatom(game, x_to, y_to, atom);
+    atomix_journal_push(game, atom, (y_from << 4) | x_from, (y_to << 4) | x_to, scoredelta);
+    return;
+  }
+  /* move the moving tile from the playfield into the animation */
+  t->data[0] = atomix_pickatom(game, x_from, y_from);
+  t->data[1] = (y_from << 4) | x_from;
+  t->data[2] = (y_to << 4) | x_to;
+  t->data[3] = scoredelta;
+  t->data[4] = -1;
+  if (sounds->soundflag != 0) t->data[4] = snd_playwav(sounds->bzzz, -1);
+}
+
+
+/* applies the effects of all animations that started or ended by now. returns
+ * the number of such events */
+static int update_anims(struct atomixgame *game, struct anim *anims, struct soundsstruct *sounds, long now) {
+  struct anim_tween t;
+  int ev, res = 0;
+  while ((ev = anim_update(anims, now, &t)) != ANIM_NONE) {
+    res++;
+    switch (t.kind) {
+      case ANIM_SLIDE:
+        if (ev != ANIM_FINISHED) break;
+        /* place the tile at its final position, and record the move in the journal */
+        atomix_placeatom(game, t.data[2] & 15, t.data[2] >> 4, t.data[0]);
+        atomix_journal_push(game, t.data[0], t.data[1], t.data[2], t.data[3]);
+        if (t.data[4] != -1) snd_wavstop(t.data[4], 100);
+        break;
+      case ANIM_EXPLOSION:
+        if (ev == ANIM_STARTED) {
+            if (sounds->soundflag != 0) snd_playwav(sounds->explode, 0);
+          } else {
+            atomix_pickatom(game, t.data[0], t.data[1]); /* update the playfield to mark the area free */
+        }
+        break;
     }
   }
-  /* rect_x = 0; */
-  for (; x != game->offseth + (x_to * TILESIZE); x += kierunekx) {
-    /* if (rect_x != 0) gra_drawsprite(empty, rect_x, rect_y); */
-    loosetile.x = x;
-    loosetile.y = y;
-    /* draw the screen */
-    if (x % 3 == 0) {
-      draw_game_screen(game, sprites, 1, time(NULL), tim_getticks(), &loosetile);
-      tim_delay(20);
+  return(res);
+}
+
+
+/* ends the slide in progress, if any, right away */
+static void finish_slide(struct atomixgame *game, struct anim *anims, struct soundsstruct *sounds) {
+  struct anim_tween *t;
+  long now = tim_getticks();
+  t = anim_find(anims, ANIM_SLIDE);
+  if (t == NULL) return;
+  anim_skip(t, now);
+  update_anims(game, anims, sounds, now);
+}
+
+
+/* waits for the time of the next frame. if the last frame has been presented
+ * on a display synced to its vertical retrace, the wait is already done */
+static void wait_next_frame(int presented) {
+  static unsigned long long nextframe = 0;
+  unsigned long long now = tim_getmicroticks();
+  if ((presented != 0) && (gra_hasvsync() != 0)) {
+    nextframe = now + FRAME_US;
+    return;
+  }
+  /* if late by more than a frame, start again from now instead of rushing */
+  if (nextframe + FRAME_US < now) nextframe = now;
+  tim_wait_until_microtick(nextframe);
+  nextframe += FRAME_US;
+}
+
+
+/* returns the tick of the next change of the game screen that is not caused
+ * by the player: the time left going down by a second, or the preview window
+ * blinking */
+static long next_visual_change(long curtick, time_t curtime) {
+  static time_t lastsecond = 0;
+  static long lastsecondtick = 0;
+  long res, nextsecond;
+  /* time() has no sub-second precision, so the tick it changes at is guessed
+   * from the last change seen. waking up a bit early is cheap, late is not */
+  if (curtime != lastsecond) {
+    lastsecond = curtime;
+    lastsecondtick = curtick;
+  }
+  nextsecond = lastsecondtick + 995;
+  if (nextsecond <= curtick) nextsecond = curtick + 5;
+  res = curtick - (curtick % 800) + 800;  /* the preview window blinks every 800 ms */
+  if (nextsecond < res) res = nextsecond;
+  return(res);
+}
+
+
+/* runs the game logic for all the fixed steps elapsed up to now. returns the
+ * number of animation events that occured */
+static int run_logic(struct atomixgame *game, struct anim *anims, struct soundsstruct *sounds, long *logictick, long now) {
+  int res = 0;
+  /* after a long break (paused game, modal screen...) don't replay every step */
+  if (now - *logictick > 250) *logictick = now - LOGIC_STEP;
+  while (*logictick + LOGIC_STEP <= now) {
+    *logictick += LOGIC_STEP;
+    res += update_anims(game, anims, sounds, *logictick);
+  }
+  return(res);
+}
+
+
+/* plays all scheduled animations until they are over, ignoring the keyboard */
+static void play_anims(struct atomixgame *game, struct anim *anims, struct spritesstruct *sprites, struct soundsstruct *sounds) {
+  long now, logictick = tim_getticks();
+  int presented;
+  while (anim_busy(anims) != 0) {
+    now = tim_getticks();
+    run_logic(game, anims, sounds, &logictick, now);
+    presented = draw_game_screen(game, sprites, 1, time(NULL), now, anims, NULL, HINT_NONE);
+    wait_next_frame(presented);
+  }
+}
+
+
+/* draws every frame of the benchmark until all animations are over, advancing
+ * the game clock by a fixed step per frame so every run draws the very same
+ * frames. returns the number of frames drawn */
+static unsigned long bench_play(struct atomixgame *game, struct anim *anims, struct spritesstruct *sprites, struct soundsstruct *sounds, time_t curtime, long *now, long *logictick) {
+  unsigned long res = 0;
+  do {
+    run_logic(game, anims, sounds, logictick, *now);
+    draw_game_screen(game, sprites, 1, curtime, *now, anims, NULL, HINT_NONE);
+    res++;
+    *now += BENCH_FRAME;
+  } while (anim_busy(anims) != 0);
+  return(res);
+}
+
+
+/* plays the solutions of levels 1 to 'levels', drawing every frame as fast as
+ * possible, and prints how many frames per second got drawn. if shotprefix is
+ * not NULL, the screen is saved after every move into a BMP file named
+ * <shotprefix>LL-MMM.bmp. levels the solver can't solve within BENCH_MAXNODES
+ * are skipped and listed, since the results of such a run can't be compared
+ * with others. returns 0 on success, 2 if any level got skipped */
+static int run_benchmark(int levels, char *shotprefix, struct spritesstruct *sprites, int *hiscores) {
+  struct atomixgame *game;
+  struct atomix_solution solution;
+  struct atomix_move *move;
+  struct soundsstruct nosound;
+  struct anim anims;
+  unsigned long long drawtime = 0, starttime;
+  unsigned long frames = 0;
+  long now = 0, logictick = 0;
+  time_t curtime;
+  int level, m, x, y, scoredelta, played = 0, skippedcount = 0;
+  char filename[4096];
+  char skipped[256];  /* numbers of the skipped levels */
+
+  nosound.soundflag = 0;
+  skipped[0] = 0;
+  game = atomix_initgame();
+  if (game == NULL) return(1);
+  for (level = 1; level <= levels; level++) {
+    anim_clear(&anims);
+    x = atomix_loadgame(game, level, ATOMIX_SRC_MEM, hiscores);
+    if (x == 0) {
+      x = atomix_solve_parallel(game, 1, BENCH_MAXNODES, ATOMIX_SOLVE_ANYSOLUTION, NULL, &solution);
+      if (x != ATOMIX_SOLVE_FOUND) atomix_freesolution(&solution);
+      x = (x == ATOMIX_SOLVE_FOUND) ? 0 : -1;
     }
+    if (x != 0) {
+      printf("level %d: no solution found, skipped\n", level);
+      snprintf(skipped + strlen(skipped), sizeof(skipped) - strlen(skipped), " %d", level);
+      skippedcount++;
+      continue;
+    }
+    curtime = game->time_end - game->duration;  /* the clock of the level never runs */
+    starttime = tim_getmicroticks();
+    for (m = 0; m <= solution.movecount; m++) {
+      if (m < solution.movecount) {
+          move = &solution.moves[m];
+          x = move->x;
+          y = move->y;
+          switch (move->direction) {
+            case 0: y -= move->distance; break;
+            case 1: x += move->distance; break;
+            case 2: y += move->distance; break;
+            default: x -= move->distance; break;
+          }
+          scoredelta = (game->score >= 5) ? -5 : 0;
+          game->score += scoredelta;
+          game->cursorx = x;
+          game->cursory = y;
+          start_slide(game, &anims, move->x, move->y, x, y, scoredelta, now, &nosound);
+        } else { /* all moves done, blow up the molecule */
+          if (atomix_checksolution(game) == 0) break;
+          start_explosions(game, &anims, now);
+      }
+      frames += bench_play(game, &anims, sprites, &nosound, curtime, &now, &logictick);
+      if (shotprefix != NULL) {
+        snprintf(filename, sizeof(filename), "%s%02d-%03d.bmp", shotprefix, level, m);
+        if (gra_savescreen(filename) != 0) printf("Could not save the screen to '%s'!\n", filename);
+      }
+    }
+    drawtime += tim_getmicroticks() - starttime;
+    atomix_freesolution(&solution);
+    played++;
   }
-  /* place the tile at its final position */
-  game->field[x_to][y_to] = loosetile.atom;
-  /* make sure the screen is up to date */
-  draw_game_screen(game, sprites, 0, time(NULL), tim_getticks(), NULL);
-  if (sndchannel != -1) snd_wavstop(sndchannel, 100);
+  free(game);
+  if (drawtime == 0) drawtime = 1;
+  printf("benchmark: %d of %d levels played, %lu frames in %.3f s, %.1f fps\n", played, levels, frames, drawtime / 1000000.0, frames * 1000000.0 / drawtime);
+  if (skippedcount > 0) {
+    printf("benchmark: %d levels skipped:%s\n", skippedcount, skipped);
+    return(2);
+  }
+  return(0);
 }
 
 
@@ -604,25 +857,58 @@ int main(int argc, char **argv) {
   int hiscores[last_level];
   struct snd_mod *music_title, *music_end;
   struct soundsstruct sounds;
-  int videoflags = 0;
+  int videoflags = GRA_VSYNC;
+  char *profdump = NULL;
+  int benchlevels = 0;     /* levels to play in benchmark mode, 0 for a normal game */
+  char *shotprefix = NULL;
+  char *packfile = NULL;
+  int texcache = 1;
+  struct hint *hints;
+  struct atomix_move hint;
+  int hintlevel = 0;  /* level the player asked hints for */
+  int hintstatus;
+  struct anim anims;
+  long logictick;
+  int presented;
+
+  anim_clear(&anims);
 
   getcfg(&max_auth_level, hiscores, last_level);
   sounds.soundflag = 1;
+  if (getenv("ATOMIKS_HEADLESS") != NULL) videoflags |= GRA_HEADLESS;
 
-  /* Look for command-line parameters (fullscreen only for now) */
+  /* Look for command-line parameters */
   for (x = 1; x < argc; x++) {
     if (strcmp(argv[x], "--fullscreen") == 0) videoflags |= GRA_FULLSCREEN;
     if (strcmp(argv[x], "--nosound") == 0) sounds.soundflag = 0;
+    if (strcmp(argv[x], "--novsync") == 0) videoflags &= ~GRA_VSYNC;
+    if ((strcmp(argv[x], "--profile") == 0) || (strncmp(argv[x], "--profile=", 10) == 0)) {
+      if (prof_init() != 0) puts("Could not start profiling!");
+      if (argv[x][9] == '=') profdump = argv[x] + 10;
+    }
+    if (strcmp(argv[x], "--headless") == 0) videoflags |= GRA_HEADLESS;
+    if (strcmp(argv[x], "--benchmark") == 0) benchlevels = 30;
+    if (strncmp(argv[x], "--benchmark=", 12) == 0) benchlevels = atoi(argv[x] + 12);
+    if (strncmp(argv[x], "--screenshots=", 14) == 0) shotprefix = argv[x] + 14;
+    if (strncmp(argv[x], "--pack=", 7) == 0) packfile = argv[x] + 7;
+    if (strcmp(argv[x], "--nocache") == 0) texcache = 0;
   }
+  /* the benchmark draws as fast as it can, and a screenshot needs no display */
+  if (benchlevels > 0) videoflags &= ~GRA_VSYNC;
+  if ((shotprefix != NULL) && (benchlevels == 0)) benchlevels = 30;
+  if (benchlevels > last_level) benchlevels = last_level;
+
+  /* map the asset pack, if any. assets it does not have come from data.h */
+  if ((pack_open(packfile) != 0) && (packfile != NULL)) printf("Could not open the asset pack '%s'!\n", packfile);
 
   /* Init SDL and set the video mode */
   #ifdef __GCW0__
-    if (gra_init(320, 240, videoflags, "Atomiks " PVER, img_tinyicon_bmp_gz, img_tinyicon_bmp_gz_len) != 0) {
+    if (gra_init(320, 240, videoflags, "Atomiks " PVER, ASSET(img_tinyicon_bmp_gz)) != 0) {
       puts("Error: unable to init screen!");
       return(1);
     }
   #else
-    if (gra_init(640, 480, videoflags, "Atomiks " PVER, img_tinyicon_bmp_gz, img_tinyicon_bmp_gz_len) != 0) {
+    if (gra_init(640, 480, videoflags, "Atomiks " PVER, ASSET(img_tinyicon_bmp_gz)) != 0) {
       puts("Error: unable to init screen!");
       return(1);
     }
@@ -632,50 +918,84 @@ int main(int argc, char **argv) {
   if (snd_init() != 0) puts("Could not initialize the sound subsystem!");
 
   /* load music and sound effects */
-  music_title = snd_loadmod(snd_title_mod, snd_title_mod_len);
+  music_title = snd_loadmod(ASSET(snd_title_mod));
   if (music_title == NULL) puts("Ooops! loading title module failed :/");
-  music_end = snd_loadmod(snd_end_mod, snd_end_mod_len);
+  music_end = snd_loadmod(ASSET(snd_end_mod));
   if (music_end == NULL) puts("Ooops! loading end module failed :/");
-  sounds.bzzz = snd_loadwav(snd_bzzz_wav, snd_bzzz_wav_len);
-  sounds.explode = snd_loadwav(snd_explode_wav, snd_explode_wav_len);
-  sounds.selected = snd_loadwav(snd_selected_wav, snd_selected_wav_len);
-
-  /* Preload all graphics */
-  title = loadgzbmp(img_title_bmp_gz, img_title_bmp_gz_len);
-  creditscreen = loadgzbmp(img_credits_bmp_gz, img_credits_bmp_gz_len);
-  timeoutscreen = loadgzbmp(img_timeout_bmp_gz, img_timeout_bmp_gz_len);
-  infoscreen = loadgzbmp(img_infoscreen_bmp_gz, img_infoscreen_bmp_gz_len);
-  pausedscreen = loadgzbmp(img_pausedscreen_bmp_gz, img_pausedscreen_bmp_gz_len);
-  instructions = loadgzbmp(img_instructs_bmp_gz, img_instructs_bmp_gz_len);
-  intro[0] = loadgzbmp(img_intro1_bmp_gz, img_intro1_bmp_gz_len);
-  intro[1] = loadgzbmp(img_intro2_bmp_gz, img_intro2_bmp_gz_len);
-  intro[2] = loadgzbmp(img_intro3_bmp_gz, img_intro3_bmp_gz_len);
-  levsel = loadgzbmp(img_levsel_bmp_gz, img_levsel_bmp_gz_len);
-  levsel2 = loadgzbmp(img_levsel2_bmp_gz, img_levsel2_bmp_gz_len);
-  sprites.completed = loadgzbmp(img_completed_bmp_gz, img_completed_bmp_gz_len);
+  sounds.bzzz = snd_loadwav(ASSET(snd_bzzz_wav));
+  sounds.explode = snd_loadwav(ASSET(snd_explode_wav));
+  sounds.selected = snd_loadwav(ASSET(snd_selected_wav));
+
+  /* keep the decoded images on disk, so the next start can skip decoding */
+  if ((texcache != 0) && (gra_enablecache("atomiks") != 0)) puts("Could not enable the texture cache!");
+
+  /* decode all sprite sheets in the background, on all cores. the loads below
+   * then turn them into sprites as soon as they are ready, in the same order */
+  gra_predecode(ASSET(img_bg_bmp_gz));
+  gra_predecode(ASSET(img_black_bmp_gz));
+  gra_predecode(ASSET(img_preview_bmp_gz));
+  gra_predecode(ASSET(img_preview2_bmp_gz));
+  gra_predecode(ASSET(img_empty_bmp_gz));
+  gra_predecode(ASSET(img_atoms_bmp_gz));
+  gra_predecode(ASSET(img_satoms_bmp_gz));
+  gra_predecode(ASSET(img_explosion_bmp_gz));
+  gra_predecode(ASSET(img_walls_bmp_gz));
+  gra_predecode(ASSET(img_cursors_bmp_gz));
+  gra_predecode(ASSET(img_font1_bmp_gz));
+  gra_predecode(ASSET(img_font2_bmp_gz));
+  gra_predecode(ASSET(img_font3_bmp_gz));
+
+  /* Register all screens. these are only decoded when drawn for the first
+   * time, and the GCW0 keeps no more than 4 of them in memory */
+  #ifdef __GCW0__
+    gra_setbudget(4 * 320 * 240 * 4);
+  #endif
+  title = loadgzbmp(ASSET(img_title_bmp_gz));
+  creditscreen = loadgzbmp(ASSET(img_credits_bmp_gz));
+  timeoutscreen = loadgzbmp(ASSET(img_timeout_bmp_gz));
+  infoscreen = loadgzbmp(ASSET(img_infoscreen_bmp_gz));
+  pausedscreen = loadgzbmp(ASSET(img_pausedscreen_bmp_gz));
+  instructions = loadgzbmp(ASSET(img_instructs_bmp_gz));
+  intro[0] = loadgzbmp(ASSET(img_intro1_bmp_gz));
+  intro[1] = loadgzbmp(ASSET(img_intro2_bmp_gz));
+  intro[2] = loadgzbmp(ASSET(img_intro3_bmp_gz));
+  levsel = loadgzbmp(ASSET(img_levsel_bmp_gz));
+  levsel2 = loadgzbmp(ASSET(img_levsel2_bmp_gz));
+  sprites.completed = loadgzbmp(ASSET(img_completed_bmp_gz));
 
   /* load backgrounds */
-  loadSpriteSheet(sprites.bg, 320, 240, 3, img_bg_bmp_gz, img_bg_bmp_gz_len);
-  loadSpriteSheet(&sprites.black, 320, 240, 1, img_black_bmp_gz, img_black_bmp_gz_len);
+  loadSpriteSheet(sprites.bg, 320, 240, 3, ASSET(img_bg_bmp_gz));
+  loadSpriteSheet(&sprites.black, 320, 240, 1, ASSET(img_black_bmp_gz));
   /* load the preview windows */
-  loadSpriteSheet(&sprites.preview[0], 71, 71, 1, img_preview_bmp_gz, img_preview_bmp_gz_len);
-  loadSpriteSheet(&sprites.preview[1], 71, 71, 1, img_preview2_bmp_gz, img_preview2_bmp_gz_len);
+  loadSpriteSheet(&sprites.preview[0], 71, 71, 1, ASSET(img_preview_bmp_gz));
+  loadSpriteSheet(&sprites.preview[1], 71, 71, 1, ASSET(img_preview2_bmp_gz));
   /* load the 'empty space' tile */
-  loadSpriteSheet(&sprites.empty, 16, 16, 1, img_empty_bmp_gz, img_empty_bmp_gz_len);
+  loadSpriteSheet(&sprites.empty, 16, 16, 1, ASSET(img_empty_bmp_gz));
   /* load atoms sprites */
-  loadSpriteSheet(sprites.atom, 16, 16, 49, img_atoms_bmp_gz, img_atoms_bmp_gz_len);
+  loadSpriteSheet(sprites.atom, 16, 16, 49, ASSET(img_atoms_bmp_gz));
   /* load 'small' atoms sprites */
-  loadSpriteSheet(sprites.satom, 8, 8, 49, img_satoms_bmp_gz, img_satoms_bmp_gz_len);
+  loadSpriteSheet(sprites.satom, 8, 8, 49, ASSET(img_satoms_bmp_gz));
   /* load the explosion sprites */
-  loadSpriteSheet(sprites.explosion, 16, 16, 8, img_explosion_bmp_gz, img_explosion_bmp_gz_len);
+  loadSpriteSheet(sprites.explosion, 16, 16, 8, ASSET(img_explosion_bmp_gz));
   /* load walls sprites */
-  loadSpriteSheet(sprites.wall, 16, 16, 19, img_walls_bmp_gz, img_walls_bmp_gz_len);
+  loadSpriteSheet(sprites.wall, 16, 16, 19, ASSET(img_walls_bmp_gz));
   /* load cursor sprites */
-  loadSpriteSheet(sprites.cursor, 16, 16, 3, img_cursors_bmp_gz, img_cursors_bmp_gz_len);
+  loadSpriteSheet(sprites.cursor, 16, 16, 3, ASSET(img_cursors_bmp_gz));
   /* load fonts */
-  loadSpriteSheet(sprites.font1, 5, 5, 37, img_font1_bmp_gz, img_font1_bmp_gz_len);
-  loadSpriteSheet(sprites.font2, 14, 16, 11, img_font2_bmp_gz, img_font2_bmp_gz_len);
-  loadSpriteSheet(sprites.font3, 7, 8, 26, img_font3_bmp_gz, img_font3_bmp_gz_len);
+  loadSpriteSheet(sprites.font1, 5, 5, 37, ASSET(img_font1_bmp_gz));
+  loadSpriteSheet(sprites.font2, 14, 16, 11, ASSET(img_font2_bmp_gz));
+  loadSpriteSheet(sprites.font3, 7, 8, 26, ASSET(img_font3_bmp_gz));
+
+  /* in benchmark mode, play the solutions of the first levels and quit */
+  if (benchlevels > 0) {
+    x = run_benchmark(benchlevels, shotprefix, &sprites, hiscores);
+    if ((profdump != NULL) && (prof_dump(profdump) != 0)) printf("Could not write profiling data to '%s'!\n", profdump);
+    prof_close();
+    snd_close();
+    gra_close();
+    pack_close();
+    return(x);
+  }
 
   /* start playing the module in an infinite loop */
   if (sounds.soundflag != 0) {
@@ -707,6 +1027,10 @@ int main(int argc, char **argv) {
   }
   inp_flush_events();
 
+  /* start the thread computing hints in the background */
+  hints = hint_init();
+  if (hints == NULL) puts("Could not start the hint system!");
+
   /* Init the game and start on level 1 */
   game = atomix_initgame();
   if (exitflag == 0) {
@@ -720,19 +1044,37 @@ int main(int argc, char **argv) {
   snd_modstop(2000);   /* slowly stop playing the background music */
   gamejuststarted = 1;
   nextscreenrefresh = 0; /* force a first refresh */
+  logictick = tim_getticks();
 
   while (exitflag == 0) {
     time_t pausedtime;
-    int cursorx_backup = game->cursorx;
-    int cursory_backup = game->cursory;
-    int tmp;
+    int cursorx_backup, cursory_backup;
+    int tmp, scoredelta;
+    struct atomix_journalentry *journalentry;
     /* Wait for next event, while keeping the screen refreshed */
     while (exitflag == 0) {
       long curtick = tim_getticks();
-      /* keep redrawing the screen every 0.2s */
-      if (curtick > nextscreenrefresh) {
-        nextscreenrefresh = curtick + 200;
-        draw_game_screen(game, &sprites, 0, time(NULL), curtick, NULL); /* draw the game only if we have time */
+      /* run the logic at a fixed timestep, and redraw at once whenever an animation starts or ends */
+      if (run_logic(game, &anims, &sounds, &logictick, curtick) != 0) nextscreenrefresh = 0;
+      /* the last slide might have solved the level */
+      if ((anim_find(&anims, ANIM_SLIDE) == NULL) && (atomix_checksolution(game) != 0)) {
+        event = atomiks_none;
+        break;
+      }
+      /* redraw the screen whenever something on it changes, and at every frame
+       * while something moves. animations are drawn where they are at the
+       * current tick, between two logic steps */
+      presented = 0;
+      if ((curtick >= nextscreenrefresh) || (anim_busy(&anims) != 0)) {
+        nextscreenrefresh = next_visual_change(curtick, time(NULL));
+        /* show the hint of the current state, if hints have been asked for on
+         * this level. look again soon if it is still being computed */
+        hintstatus = HINT_NONE;
+        if ((hintlevel == game->level) && (hints != NULL)) {
+          hintstatus = hint_get(hints, game, &hint, NULL);
+          if ((hintstatus == HINT_PENDING) && (nextscreenrefresh > curtick + 200)) nextscreenrefresh = curtick + 200;
+        }
+        presented = draw_game_screen(game, &sprites, 0, time(NULL), curtick, &anims, &hint, hintstatus); /* draw the game only if we have time */
         /* if we are starting Atomix experience, display a short notice */
         if ((game->level == 1) && (max_auth_level == 1) && (gamejuststarted == 1)) {
           gra_drawsprite(instructions, 0, 0);
@@ -749,13 +1091,30 @@ int main(int argc, char **argv) {
           tim_delay(1000);
           inp_flush_events();
           exitflag = waitforanykey(0, NULL);
+          anim_clear(&anims);
           atomix_loadgame(game, game->level, ATOMIX_SRC_MEM, hiscores);
         }
       }
-      event = pollkey();
-      if (event != atomiks_none) break;
-      tim_delay(20);
+      /* while something moves, poll the keyboard at every frame. otherwise sleep
+       * until a key is pressed or the screen has to change */
+      if (anim_busy(&anims) != 0) {
+          event = pollkey();
+          if (event != atomiks_none) break;
+          wait_next_frame(presented);
+        } else {
+          curtick = tim_getticks();
+          event = inp_waitkey((nextscreenrefresh > curtick) ? nextscreenrefresh - curtick : -1);
+          if (event != atomiks_none) break;
+      }
     }
+    /* a key pressed while an atom slides ends the slide at once, so the next
+     * move never waits for the previous one */
+    if (event != atomiks_none) {
+      finish_slide(game, &anims, &sounds);
+      if ((atomix_checksolution(game) != 0) && (event != atomiks_quit)) event = atomiks_none;
+    }
+    cursorx_backup = game->cursorx;
+    cursory_backup = game->cursory;
     switch (event) {
       case atomiks_quit:
         exitflag = 1;
@@ -777,49 +1136,53 @@ int main(int argc, char **argv) {
         break;
       case atomiks_left:
         if (game->cursorstate == 0) {
-            move_cursor_left(game, &sprites);
+            move_cursor(game, &anims, -1, 0);
           } else {
             tmp = atomix_getmovedistance(game, 3);
             if (tmp != 0) {
-              if (game->score >= 5) game->score -= 5;
+              scoredelta = (game->score >= 5) ? -5 : 0;
+              game->score += scoredelta;
               game->cursorx -= tmp;
-              move_atom(game, cursorx_backup, cursory_backup, game->cursorx, game->cursory, &sounds, &sprites);
+              start_slide(game, &anims, cursorx_backup, cursory_backup, game->cursorx, game->cursory, scoredelta, tim_getticks(), &sounds);
             }
         }
         break;
       case atomiks_right:
         if (game->cursorstate == 0) {
-            move_cursor_right(game, &sprites);
+            move_cursor(game, &anims, 1, 0);
           } else {
             tmp = atomix_getmovedistance(game, 1);
             if (tmp != 0) {
-              if (game->score >= 5) game->score -= 5;
+              scoredelta = (game->score >= 5) ? -5 : 0;
+              game->score += scoredelta;
               game->cursorx += tmp;
-              move_atom(game, cursorx_backup, cursory_backup, game->cursorx, game->cursory, &sounds, &sprites);
+              start_slide(game, &anims, cursorx_backup, cursory_backup, game->cursorx, game->cursory, scoredelta, tim_getticks(), &sounds);
             }
         }
         break;
       case atomiks_up:
         if (game->cursorstate == 0) {
-            move_cursor_up(game, &sprites);
+            move_cursor(game, &anims, 0, -1);
           } else {
             tmp = atomix_getmovedistance(game, 0);
             if (tmp != 0) {
-              if (game->score >= 5) game->score -= 5;
+              scoredelta = (game->score >= 5) ? -5 : 0;
+              game->score += scoredelta;
               game->cursory -= tmp;
-              move_atom(game, cursorx_backup, cursory_backup, game->cursorx, game->cursory, &sounds, &sprites);
+              start_slide(game, &anims, cursorx_backup, cursory_backup, game->cursorx, game->cursory, scoredelta, tim_getticks(), &sounds);
             }
         }
         break;
       case atomiks_down:
         if (game->cursorstate == 0) {
-            move_cursor_down(game, &sprites);
+            move_cursor(game, &anims, 0, 1);
           } else {
             tmp = atomix_getmovedistance(game, 2);
             if (tmp != 0) {
-              if (game->score >= 5) game->score -= 5;
+              scoredelta = (game->score >= 5) ? -5 : 0;
+              game->score += scoredelta;
               game->cursory += tmp;
-              move_atom(game, cursorx_backup, cursory_backup, game->cursorx, game->cursory, &sounds, &sprites);
+              start_slide(game, &anims, cursorx_backup, cursory_backup, game->cursorx, game->cursory, scoredelta, tim_getticks(), &sounds);
             }
         }
         break;
@@ -831,6 +1194,7 @@ int main(int argc, char **argv) {
             exitflag = 1;
           } else {
             snd_modstop(2000);
+            anim_clear(&anims);
             atomix_loadgame(game, game->level, ATOMIX_SRC_MEM, hiscores);
         }
         break;
@@ -849,6 +1213,36 @@ int main(int argc, char **argv) {
       case atomiks_fullscreen:
         gra_switchfullscreen();
         break;
+      case atomiks_undo:
+        journalentry = atomix_undo(game);
+        if (journalentry != NULL) { /* put the cursor on the atom that moved back */
+          game->cursorx = journalentry->from & 15;
+          game->cursory = journalentry->from >> 4;
+        }
+        nextscreenrefresh = 0;
+        break;
+      case atomiks_redo:
+        journalentry = atomix_redo(game);
+        if (journalentry != NULL) {
+          game->cursorx = journalentry->to & 15;
+          game->cursory = journalentry->to >> 4;
+        }
+        nextscreenrefresh = 0;
+        break;
+      #ifdef __GCW0__
+      case atomiks_home: /* Y */
+      #endif
+      case atomiks_profile:
+        if (prof_enabled() != 0) profoverlay ^= 1;
+        nextscreenrefresh = 0;
+        break;
+      case atomiks_hint:
+        if (hints != NULL) {
+          hint_request(hints, game);
+          hintlevel = game->level;
+        }
+        nextscreenrefresh = 0;
+        break;
       default:
         break;
     }
@@ -856,12 +1250,13 @@ int main(int argc, char **argv) {
     if (atomix_checksolution(game) != 0) {
       time_t tmptime;
       if (game->level == max_auth_level) max_auth_level += 1;
-      draw_game_screen(game, &sprites, 1, time(NULL), tim_getticks(), NULL);
-      draw_anim_explosions(game, &sprites, &sounds); /* animate atoms explosion */
+      anim_clear(&anims);
+      start_explosions(game, &anims, tim_getticks());
+      play_anims(game, &anims, &sprites, &sounds); /* animate atoms explosion */
       tim_delay(750);
       for (tmptime = time(NULL); tmptime <= game->time_end; tmptime++) {
         game->score += 10;
-        draw_game_screen(game, &sprites, 1, tmptime, tim_getticks(), NULL);
+        draw_game_screen(game, &sprites, 1, tmptime, tim_getticks(), NULL, NULL, HINT_NONE);
         if (tmptime % 2) tim_delay(10);
       }
       if (game->score > hiscores[game->level - 1]) hiscores[game->level - 1] = game->score;
@@ -934,8 +1329,11 @@ int main(int argc, char **argv) {
   }
 
   savecfg(max_auth_level, hiscores, last_level);
+  if ((profdump != NULL) && (prof_dump(profdump) != 0)) printf("Could not write profiling data to '%s'!\n", profdump);
+  prof_close();
 
   /* cleaning up stuff */
+  hint_close(hints);
   free(game);
   /* SDL_FreeSurface(sprites.bg[0]);
   SDL_FreeSurface(creditscreen);
@@ -949,5 +1347,6 @@ int main(int argc, char **argv) {
   snd_wavfree(sounds.selected);
   snd_close();  /* this one takes a long time (~2s) when using the PulseAudio driver... This is a known bug, there's not much I can do about this */
   gra_close();
+  pack_close();
   return(0);
 }
@@ -0,0 +1,1476 @@
+/*
+ * This is part of the Atomiks project.
+ * Copyright (C) Mateusz Viste 2013, 2014, 2015
+ *
+ * Finds optimal solutions to Atomix levels, using an A* search over the
+ * positions of the atoms on the playfield, or, when asked to, solutions that
+ * may not be optimal for levels too big for that.
+ *
+ * A search state is nothing more than the packed state of the game (one
+ * byte per atom, y * 16 + x, sorted within every kind of atom), since walls
+ * never move. The heuristic is the
+ * cheapest placement of the molecule, where atoms of every kind are matched
+ * to distinct target cells of their kind, every atom costing the number of
+ * moves it would need to reach its target if no other atom was on the way.
+ * This never overestimates the real cost, and since a move changes the cost
+ * of a single atom by at most one, f = g + h never decreases along a path.
+ *
+ * The latter allows the search to expand states one f layer at a time:
+ * every state of a layer is expanded before the next layer starts, so the
+ * first goal state found lies on the lowest possible layer, whatever the
+ * order in which states of this layer got expanded. Layers are expanded by
+ * a pool of threads, each having its own deque of states to expand and
+ * stealing work from other threads' deques whenever its own runs dry.
+ * Known states are kept in a hash table split into shards, each of them
+ * protected by its own lock.
+ *
+ * Most children of a state lie on higher layers than their parent, and many
+ * of them are never expanded before the goal is met. The optimal search
+ * leaves them out of the table: it only keeps the children on the layer
+ * being expanded, and the parent waits on the lowest layer of the others,
+ * to be expanded again there (partial expansion). Since the heuristic is
+ * consistent, that's twice at most. Only the kind of atom that moved needs
+ * its cost worked out again for a child.
+ *
+ * Bigger levels are out of reach of an optimal search. When the caller asks
+ * for any solution, once the search runs out of nodes or memory, the
+ * molecule is built one target cell after the other instead. Every stage
+ * is a weighted search (f = g + 2h) for a state that keeps the targets
+ * filled so far and fills one more, without walling off the targets left.
+ * Solutions found that way are usually far from optimal, but they exist.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>    /* malloc(), realloc(), free() */
+#include <string.h>    /* memchr(), memcpy(), memmove(), memset() */
+#include <time.h>
+#include <sys/time.h>  /* gettimeofday() */
+#include <sched.h>     /* sched_yield() */
+#include <pthread.h>
+#include "atomcore.h"
+#include "atomsolve.h" /* include self for control */
+
+#define MAXATOMS 64        /* there are only 64 atom indexes anyway */
+#define MAXDEPTH 250       /* g values are stored on a single byte */
+#define UNREACHABLE 255    /* relaxed distance of cells that can't be reached at all */
+#define DEADEND 0xFFFF     /* heuristic value of states that can't be solved anymore */
+#define NONODE 0xFFFFFFFFu
+#define CHUNKSIZE 16384    /* nodes are allocated by chunks of this many nodes */
+#define MAXCHUNKS 65536    /* that's up to 1G nodes */
+#define SHARDCOUNT 256     /* the hash table is split in that many independently locked parts */
+#define KINDMATCH 10       /* kinds with up to this many targets get their atoms matched to targets exactly */
+#define STAGEWEIGHT 2      /* stages look for f = g + STAGEWEIGHT * h */
+#define STAGENODES 50000   /* first node budget of a stage, that grows up to STAGEGROWTH times when the stage fails */
+#define STAGEGROWTH 16
+#define STAGERUNS 8        /* number of times every placement is retried, pushing the targets it got stuck on first */
+#define STAGEFAR 30000     /* stage heuristic value of targets that no atom is heading for */
+
+struct solvenode {
+  unsigned int parent;    /* index of the parent node, NONODE for the root */
+  unsigned short h;       /* heuristic estimate of the remaining moves */
+  unsigned char g;        /* number of moves done so far */
+  unsigned char fdelta;   /* the node waits on layer g + h + fdelta, its children of lower layers being known */
+};
+
+struct hashslot {
+  unsigned int node;      /* node index, NONODE for empty slots */
+  unsigned int tag;       /* upper bits of the node's hash, to skip most comparisons of positions */
+};
+
+struct solveshard {
+  pthread_mutex_t lock;
+  struct hashslot *tab;
+  unsigned long size;     /* always a power of two */
+  unsigned long count;
+};
+
+struct solvebucket {      /* list of nodes sharing the same f = g + h */
+  unsigned int *list;
+  unsigned long len;
+  unsigned long size;
+};
+
+struct solver;
+
+struct solveworker {
+  struct solver *s;
+  pthread_t thread;
+  pthread_mutex_t lock;       /* protects the deque */
+  unsigned int *deque;        /* the owner works at the tail, thieves steal at the head */
+  unsigned long head;
+  unsigned long tail;
+  unsigned long size;
+  unsigned int chunknode;     /* next free node of the worker's current chunk */
+  unsigned int chunkend;
+  struct solvebucket *later;  /* nodes generated for upcoming layers */
+  int latersize;
+  unsigned long expanded;
+  unsigned long generated;
+  unsigned long steals;
+  /* relaxed costs of the node being expanded, so its children only work out the cost of the kind that moved */
+  int *kindcosts;             /* cost of every kind on every placement */
+  int *placesum;              /* cost of every placement, kinds that can't reach it left out */
+  int *placedead;             /* number of kinds that can't reach every placement */
+  int rawh;                   /* heuristic of the node, before pathmax */
+};
+
+struct solver {
+  int atomcount;
+  int targetcount;
+  int goalcount;
+  int kindcount;
+  unsigned char blocked[256];         /* non-zero for cells atoms can never enter */
+  struct atomix_bitboard walls;       /* walls of the level, atoms left out */
+  unsigned char atomkind[MAXATOMS];   /* kind of every atom - atoms are sorted by kind */
+  unsigned char kindval[MAXATOMS];    /* field value of every kind of atom */
+  int kindfirst[MAXATOMS];            /* first atom of every kind */
+  int kindend[MAXATOMS];              /* last atom of every kind, plus one */
+  int targetfirst[MAXATOMS];          /* first target cell of every kind - targets are sorted by kind too */
+  int targetend[MAXATOMS];
+  unsigned char *goals;               /* goalcount placements, targetcount cells each */
+  unsigned char dist[256][256];       /* relaxed distance between any two cells */
+  /* node storage, shared by all workers */
+  unsigned char **chunks;
+  unsigned int chunkcount;
+  pthread_mutex_t chunklock;
+  struct solveshard shard[SHARDCOUNT];
+  pthread_mutex_t countlock;          /* protects the counters below, for compilers with no atomic builtins */
+  unsigned long memory;               /* bytes held by nodes and the hash table */
+  unsigned long maxmemory;
+  unsigned long peakstored;           /* the most nodes and memory any single search used */
+  unsigned long peakmemory;
+  struct solvebucket *open;           /* nodes waiting for their layer */
+  int opensize;
+  /* threads of the pool, started once for the whole solve. Worker 0 is the calling thread */
+  struct solveworker *worker;
+  int workercount;
+  pthread_mutex_t poollock;
+  pthread_cond_t poolwake;            /* a new layer is ready, or the pool must quit */
+  pthread_cond_t pooldone;            /* the last pool thread is done with the layer */
+  unsigned long poolround;            /* number of layers handed to the pool so far */
+  int poolbusy;                       /* pool threads still working on the layer */
+  int poolquit;
+  int poolthreads;                    /* pool threads that are running */
+  /* the current layer */
+  int weight;                         /* f = g + weight * h */
+  int layer;
+  int bound;                          /* first layer that hasn't been fully expanded */
+  unsigned long pending;              /* nodes pushed to the layer but not expanded yet */
+  unsigned long maxnodes;
+  unsigned long expanded;
+  pthread_mutex_t stoplock;
+  volatile int stop;                  /* set when the layer must stop at once */
+  volatile int *cancel;               /* set by the caller when it no longer wants the result */
+  int result;
+  unsigned int goal;
+  /* stages of the fallback search */
+  int staged;                         /* non-zero when looking for the next stage rather than for the molecule */
+  int placement;                      /* the placement being built */
+  int nexttarget;                     /* target to fill at this stage, -1 for any */
+  int guided;                         /* non-zero to count moves around the atoms in place, not the relaxed ones */
+  int rootstuck;                      /* targets that could not be filled one by one at the root of the stage */
+  unsigned char required[MAXATOMS];   /* non-zero for targets filled at the root of the stage */
+  unsigned long spent;                /* nodes expanded by all stages so far */
+};
+
+static unsigned long solvememory = ATOMIX_SOLVE_DEFMEMORY;
+
+
+/* adds delta to a counter shared by all threads, and returns its new value */
+static unsigned long countadd(struct solver *s, volatile unsigned long *counter, long delta) {
+#ifdef __GNUC__
+  (void)s;
+  return(__sync_add_and_fetch(counter, delta));
+#else
+  unsigned long res;
+  pthread_mutex_lock(&(s->countlock));
+  *counter += delta;
+  res = *counter;
+  pthread_mutex_unlock(&(s->countlock));
+  return(res);
+#endif
+}
+
+
+static struct solvenode *getnode(struct solver *s, unsigned int id) {
+  return((struct solvenode *)(s->chunks[id / CHUNKSIZE]) + (id % CHUNKSIZE));
+}
+
+
+static unsigned char *getpos(struct solver *s, unsigned int id) {
+  return(s->chunks[id / CHUNKSIZE] + CHUNKSIZE * sizeof(struct solvenode) + (id % CHUNKSIZE) * s->atomcount);
+}
+
+
+/* returns the cell next to 'cell' in direction 'dir', or -1 if it falls off the 16x16 board */
+static int nextcell(int cell, int dir) {
+  switch (dir) {
+    case 0:
+      if (cell < 16) return(-1);
+      return(cell - 16);
+    case 1:
+      if ((cell & 15) == 15) return(-1);
+      return(cell + 1);
+    case 2:
+      if (cell >= 240) return(-1);
+      return(cell + 16);
+    default:
+      if ((cell & 15) == 0) return(-1);
+      return(cell - 1);
+  }
+}
+
+
+/* computes the number of moves a lone atom needs to go from any cell to any
+ * other cell, assuming it could stop anywhere (ie. other atoms would always
+ * be right where needed to stop it) */
+static void compute_distances(struct solver *s) {
+  unsigned char queue[256];
+  int from, qhead, qtail, cell, next, dir;
+  memset(s->dist, UNREACHABLE, sizeof(s->dist));
+  for (from = 0; from < 256; from++) {
+    if (s->blocked[from] != 0) continue;
+    s->dist[from][from] = 0;
+    qhead = 0;
+    qtail = 0;
+    queue[qtail++] = from;
+    while (qhead < qtail) {
+      cell = queue[qhead++];
+      for (dir = 0; dir < 4; dir++) {
+        for (next = nextcell(cell, dir); (next >= 0) && (s->blocked[next] == 0); next = nextcell(next, dir)) {
+          if (s->dist[from][next] != UNREACHABLE) continue;
+          s->dist[from][next] = s->dist[from][cell] + 1;
+          queue[qtail++] = next;
+        }
+      }
+    }
+  }
+}
+
+
+/* cheapest way of bringing atoms of kind k onto its target cells of a
+ * placement, every target getting an atom of its own. returns DEADEND if
+ * the targets can't all be reached */
+static int kindcost(struct solver *s, unsigned char *pos, int k, unsigned char *goalcells) {
+  int cost[MAXATOMS], near[MAXATOMS], dp[1 << KINDMATCH];
+  unsigned char taken[MAXATOMS];
+  int a, t, d, i, j, n, m, sum, mask, full, clash = 0;
+  m = s->targetend[k] - s->targetfirst[k];
+  goalcells += s->targetfirst[k];
+  /* every atom costs the distance to its closest target */
+  n = 0;
+  for (a = s->kindfirst[k]; a < s->kindend[k]; a++) {
+    cost[n] = UNREACHABLE;
+    near[n] = 0;
+    for (t = 0; t < m; t++) {
+      d = s->dist[pos[a]][goalcells[t]];
+      if (d < cost[n]) {
+        cost[n] = d;
+        near[n] = t;
+      }
+    }
+    n++;
+  }
+  /* if there are more atoms than targets, only the cheapest ones count */
+  if (n > m) {
+    for (i = 0; i < m; i++) {
+      for (j = i + 1; j < n; j++) {
+        if (cost[j] < cost[i]) {
+          d = cost[i];
+          cost[i] = cost[j];
+          cost[j] = d;
+          d = near[i];
+          near[i] = near[j];
+          near[j] = d;
+        }
+      }
+    }
+  }
+  memset(taken, 0, m);
+  sum = 0;
+  for (i = 0; i < m; i++) {
+    if (cost[i] == UNREACHABLE) return(DEADEND); /* this atom can't reach any target */
+    sum += cost[i];
+    if (taken[near[i]] != 0) clash = 1;
+    taken[near[i]] = 1;
+  }
+  /* if atoms all head for different targets, that's the best assignment already */
+  if ((clash == 0) || (m > KINDMATCH)) return(sum);
+  /* otherwise find the best one: dp[mask] is the cheapest way of filling the targets of mask with the atoms seen so far */
+  full = (1 << m) - 1;
+  dp[0] = 0;
+  for (mask = 1; mask <= full; mask++) dp[mask] = DEADEND;
+  for (a = s->kindfirst[k]; a < s->kindend[k]; a++) {
+    for (mask = full - 1; mask >= 0; mask--) {
+      if (dp[mask] == DEADEND) continue;
+      for (t = 0; t < m; t++) {
+        if ((mask & (1 << t)) != 0) continue;
+        d = s->dist[pos[a]][goalcells[t]];
+        if ((d != UNREACHABLE) && (dp[mask] + d < dp[mask | (1 << t)])) dp[mask | (1 << t)] = dp[mask] + d;
+      }
+    }
+  }
+  return(dp[full]);
+}
+
+
+/* relaxed cost of assembling the molecule on a placement. Gives up as soon as the cost reaches 'limit' */
+static int placementcost(struct solver *s, unsigned char *pos, unsigned char *goalcells, int limit) {
+  int k, c, sum = 0;
+  for (k = 0; (k < s->kindcount) && (sum < limit); k++) {
+    if (s->targetfirst[k] == s->targetend[k]) continue; /* the molecule doesn't use this kind of atom */
+    c = kindcost(s, pos, k, goalcells);
+    if (c == DEADEND) return(DEADEND);
+    sum += c;
+  }
+  return(sum);
+}
+
+
+/* returns non-zero if an atom of kind k stands on the cell */
+static int isfilled(struct solver *s, unsigned char *pos, int k, int cell) {
+  int a;
+  for (a = s->kindfirst[k]; a < s->kindend[k]; a++) {
+    if (pos[a] == cell) return(1);
+  }
+  return(0);
+}
+
+
+/* counts the empty targets of a placement that can't be filled one after
+ * the other, every atom coming in through a free cell and stopping against
+ * a wall or a target filled before. 'filled' flags the filled cells */
+static int stuckcount(struct solver *s, unsigned char *goalcells, unsigned char *filled) {
+  unsigned char done[256];
+  int left = 0, progress = 1, t, dir, from, stop;
+  memcpy(done, filled, sizeof(done));
+  for (t = 0; t < s->targetcount; t++) {
+    if (done[goalcells[t]] == 0) left++;
+  }
+  while ((left > 0) && (progress != 0)) {
+    progress = 0;
+    for (t = 0; t < s->targetcount; t++) {
+      if (done[goalcells[t]] != 0) continue;
+      for (dir = 0; dir < 4; dir++) {
+        from = nextcell(goalcells[t], (dir + 2) & 3);
+        stop = nextcell(goalcells[t], dir);
+        if ((from < 0) || (s->blocked[from] != 0) || (done[from] != 0)) continue;
+        if ((stop >= 0) && (s->blocked[stop] == 0) && (done[stop] == 0)) continue;
+        break;
+      }
+      if (dir == 4) continue;
+      done[goalcells[t]] = 1;
+      left--;
+      progress = 1;
+    }
+  }
+  return(left);
+}
+
+
+/* number of moves an atom needs to reach 'target' from every cell, the other
+ * atoms standing still, found by going backwards from the target. Cells it
+ * can't be reached from are left at 255 */
+static void reversedist(struct solver *s, unsigned char *pos, int target, unsigned char *d) {
+  unsigned char occupied[256], queue[256];
+  int i, qhead = 0, qtail = 0, cell, dir, stop, from;
+  memset(occupied, 0, sizeof(occupied));
+  for (i = 0; i < s->atomcount; i++) occupied[pos[i]] = 1;
+  memset(d, 255, 256);
+  d[target] = 0;
+  if (occupied[target] != 0) return;
+  queue[qtail++] = target;
+  while (qhead < qtail) {
+    cell = queue[qhead++];
+    for (dir = 0; dir < 4; dir++) {
+      /* an atom moving in direction dir stops on cell only if the next one is taken */
+      stop = nextcell(cell, dir);
+      if ((stop >= 0) && (s->blocked[stop] == 0) && (occupied[stop] == 0)) continue;
+      for (from = nextcell(cell, (dir + 2) & 3); (from >= 0) && (s->blocked[from] == 0); from = nextcell(from, (dir + 2) & 3)) {
+        if (d[from] == 255) {
+          d[from] = d[cell] + 1;
+          if (occupied[from] == 0) queue[qtail++] = from;
+        }
+        if (occupied[from] != 0) break; /* the atom standing there is the one that moves */
+      }
+    }
+  }
+}
+
+
+/* estimate of the moves left to finish the current stage: the targets filled
+ * at the root of the stage must be filled again, and one more target too.
+ * This is no lower bound at all, it only leads the search. returns 0 for
+ * states that finish the stage */
+static int stageheuristic(struct solver *s, unsigned char *pos) {
+  unsigned char *goalcells = s->goals + s->placement * s->targetcount;
+  unsigned char filled[256], rev[256];
+  int k, t, a, d, c, sum = 0, extra = STAGEFAR, nfilled = 0, nrequired = 0;
+  memset(filled, 0, sizeof(filled));
+  for (k = 0; k < s->kindcount; k++) {
+    for (t = s->targetfirst[k]; t < s->targetend[k]; t++) {
+      d = UNREACHABLE;
+      for (a = s->kindfirst[k]; a < s->kindend[k]; a++) {
+        if (s->dist[pos[a]][goalcells[t]] < d) d = s->dist[pos[a]][goalcells[t]];
+      }
+      if (d == UNREACHABLE) return(DEADEND);
+      if (d == 0) {
+        nfilled++;
+        filled[goalcells[t]] = 1;
+      }
+      /* the targets the stage is about can be looked at more closely: an atom
+       * that can't get there with the others in place needs some help */
+      if ((d > 0) && (s->guided != 0) && ((s->required[t] != 0) || (s->nexttarget == t))) {
+        reversedist(s, pos, goalcells[t], rev);
+        d = STAGEFAR;
+        for (a = s->kindfirst[k]; a < s->kindend[k]; a++) {
+          if (s->dist[pos[a]][goalcells[t]] == UNREACHABLE) continue;
+          c = rev[pos[a]];
+          if (c == 255) c = s->dist[pos[a]][goalcells[t]] * 2 + 2;
+          if (c < d) d = c;
+        }
+      }
+      if (s->required[t] != 0) {
+          nrequired++;
+          sum += d;
+        } else if ((d > 0) && (d < extra) && ((s->nexttarget == t) || (s->nexttarget < 0))) {
+          extra = d;
+      }
+    }
+  }
+  if ((extra < STAGEFAR) && ((s->nexttarget >= 0) || (nfilled <= nrequired))) sum += extra;
+  /* filling a target is of no use if it walls off targets still empty */
+  if ((sum == 0) && (stuckcount(s, goalcells, filled) > s->rootstuck)) return(1);
+  return(sum);
+}
+
+
+/* returns a lower bound of the number of moves needed to solve the state, or
+ * DEADEND if it can't be solved at all. Stages get their own estimate */
+static int heuristic(struct solver *s, unsigned char *pos) {
+  int best = DEADEND, goal, c;
+  if (s->staged != 0) return(stageheuristic(s, pos));
+  for (goal = 0; goal < s->goalcount; goal++) {
+    c = placementcost(s, pos, s->goals + goal * s->targetcount, best);
+    if (c < best) best = c;
+  }
+  return(best);
+}
+
+
+/* works out the cost of every kind on every placement for a node about to be
+ * expanded, so childheuristic() can tell the cost of its children quickly */
+static void parentcosts(struct solver *s, struct solveworker *w, unsigned char *pos) {
+  int goal, k, c;
+  w->rawh = DEADEND;
+  for (goal = 0; goal < s->goalcount; goal++) {
+    w->placesum[goal] = 0;
+    w->placedead[goal] = 0;
+    for (k = 0; k < s->kindcount; k++) {
+      if (s->targetfirst[k] == s->targetend[k]) continue;
+      c = kindcost(s, pos, k, s->goals + goal * s->targetcount);
+      w->kindcosts[goal * s->kindcount + k] = c;
+      if (c == DEADEND) {
+          w->placedead[goal] += 1;
+        } else {
+          w->placesum[goal] += c;
+      }
+    }
+    if ((w->placedead[goal] == 0) && (w->placesum[goal] < w->rawh)) w->rawh = w->placesum[goal];
+  }
+}
+
+
+/* same as heuristic(), for a child of the node given to parentcosts(), in
+ * which an atom of kind k moved. Only the cost of that kind changes */
+static int childheuristic(struct solver *s, struct solveworker *w, unsigned char *pos, int k) {
+  int best = DEADEND, goal, rest, c, old;
+  if (s->staged != 0) return(stageheuristic(s, pos));
+  if (s->targetfirst[k] == s->targetend[k]) return(w->rawh); /* the molecule doesn't use this kind of atom */
+  for (goal = 0; goal < s->goalcount; goal++) {
+    old = w->kindcosts[goal * s->kindcount + k];
+    if (w->placedead[goal] > ((old == DEADEND) ? 1 : 0)) continue; /* other kinds can't get there */
+    rest = w->placesum[goal];
+    if (old != DEADEND) rest -= old;
+    if (rest >= best) continue;
+    c = kindcost(s, pos, k, s->goals + goal * s->targetcount);
+    if ((c != DEADEND) && (rest + c < best)) best = rest + c;
+  }
+  return(best);
+}
+
+
+/* returns the zobrist hash of a state */
+static unsigned long long hashpos(struct solver *s, unsigned char *pos) {
+  unsigned long long h = 0;
+  int i;
+  for (i = 0; i < s->atomcount; i++) h ^= atomix_zobristkey(s->kindval[s->atomkind[i]], pos[i] & 15, pos[i] >> 4);
+  return(h);
+}
+
+
+/* looks up a state in a (locked) shard of the hash table. returns a pointer
+ * to the slot it occupies, or to the empty slot where it should be inserted */
+static struct hashslot *hashslot(struct solver *s, struct solveshard *shard, unsigned char *pos, unsigned long long hash) {
+  unsigned long i;
+  unsigned int tag;
+  i = (unsigned long)hash & (shard->size - 1);
+  tag = (unsigned int)(hash >> 32);
+  for (;;) {
+    if (shard->tab[i].node == NONODE) {
+      shard->tab[i].tag = tag;
+      return(&(shard->tab[i]));
+    }
+    if ((shard->tab[i].tag == tag) && (memcmp(getpos(s, shard->tab[i].node), pos, s->atomcount) == 0)) return(&(shard->tab[i]));
+    i = (i + 1) & (shard->size - 1);
+  }
+}
+
+
+/* doubles the size of a (locked) shard. returns 0 on success, non-zero on out of memory */
+static int hashgrow(struct solver *s, struct solveshard *shard) {
+  struct hashslot *oldtab;
+  unsigned long i, oldsize;
+  unsigned char *pos;
+  oldtab = shard->tab;
+  oldsize = shard->size;
+  shard->tab = malloc(oldsize * 2 * sizeof(struct hashslot));
+  if (shard->tab == NULL) {
+    shard->tab = oldtab;
+    return(-1);
+  }
+  shard->size = oldsize * 2;
+  countadd(s, &(s->memory), oldsize * sizeof(struct hashslot));
+  for (i = 0; i < shard->size; i++) shard->tab[i].node = NONODE;
+  for (i = 0; i < oldsize; i++) {
+    if (oldtab[i].node == NONODE) continue;
+    pos = getpos(s, oldtab[i].node);
+    hashslot(s, shard, pos, hashpos(s, pos))->node = oldtab[i].node;
+  }
+  free(oldtab);
+  return(0);
+}
+
+
+/* adds a node to a list of nodes. returns 0 on success, non-zero on out of memory */
+static int bucketpush(struct solvebucket *b, unsigned int node) {
+  unsigned int *newlist;
+  if (b->len == b->size) {
+    newlist = realloc(b->list, (b->size * 2 + 1024) * sizeof(unsigned int));
+    if (newlist == NULL) return(-1);
+    b->list = newlist;
+    b->size = b->size * 2 + 1024;
+  }
+  b->list[b->len++] = node;
+  return(0);
+}
+
+
+/* returns the bucket of layer f within an array of buckets, growing the array if needed. returns NULL on out of memory */
+static struct solvebucket *getbucket(struct solvebucket **buckets, int *size, int f) {
+  struct solvebucket *b;
+  int i;
+  if (f >= *size) {
+    b = realloc(*buckets, (f + 64) * sizeof(struct solvebucket));
+    if (b == NULL) return(NULL);
+    *buckets = b;
+    for (i = *size; i < f + 64; i++) {
+      b[i].list = NULL;
+      b[i].len = 0;
+      b[i].size = 0;
+    }
+    *size = f + 64;
+  }
+  return(&((*buckets)[f]));
+}
+
+
+/* allocates a new node for a worker. returns its index, or NONODE on out of memory */
+static unsigned int newnode(struct solver *s, struct solveworker *w, unsigned char *pos) {
+  unsigned int id, chunk;
+  if (w->chunknode == w->chunkend) { /* the worker needs a new chunk */
+    pthread_mutex_lock(&(s->chunklock));
+    chunk = s->chunkcount;
+    if (chunk < MAXCHUNKS) {
+      s->chunks[chunk] = malloc(CHUNKSIZE * (sizeof(struct solvenode) + s->atomcount));
+      if (s->chunks[chunk] != NULL) {
+        s->chunkcount += 1;
+        countadd(s, &(s->memory), CHUNKSIZE * (sizeof(struct solvenode) + s->atomcount));
+      }
+    }
+    pthread_mutex_unlock(&(s->chunklock));
+    if ((chunk == MAXCHUNKS) || (s->chunks[chunk] == NULL)) return(NONODE);
+    w->chunknode = chunk * CHUNKSIZE;
+    w->chunkend = w->chunknode + CHUNKSIZE;
+  }
+  id = w->chunknode++;
+  memcpy(getpos(s, id), pos, s->atomcount);
+  return(id);
+}
+
+
+/* pushes a node on the tail of a worker's deque. returns 0 on success, non-zero on out of memory */
+static int dequepush(struct solveworker *w, unsigned int node) {
+  unsigned int *newdeque;
+  int res = 0;
+  pthread_mutex_lock(&(w->lock));
+  if (w->tail == w->size) {
+    if (w->head > 0) { /* reuse the space freed by thieves */
+        memmove(w->deque, w->deque + w->head, (w->tail - w->head) * sizeof(unsigned int));
+        w->tail -= w->head;
+        w->head = 0;
+      } else {
+        newdeque = realloc(w->deque, (w->size * 2 + 1024) * sizeof(unsigned int));
+        if (newdeque == NULL) {
+            res = -1;
+          } else {
+            w->deque = newdeque;
+            w->size = w->size * 2 + 1024;
+        }
+    }
+  }
+  if (res == 0) w->deque[w->tail++] = node;
+  pthread_mutex_unlock(&(w->lock));
+  return(res);
+}
+
+
+/* takes a node from the tail of a worker's own deque (fromhead == 0), or from its head for thieves. returns NONODE if empty */
+static unsigned int dequepop(struct solveworker *w, int fromhead) {
+  unsigned int res = NONODE;
+  pthread_mutex_lock(&(w->lock));
+  if (w->head < w->tail) {
+    if (fromhead != 0) {
+        res = w->deque[w->head++];
+      } else {
+        res = w->deque[--(w->tail)];
+    }
+    if (w->head == w->tail) {
+      w->head = 0;
+      w->tail = 0;
+    }
+  }
+  pthread_mutex_unlock(&(w->lock));
+  return(res);
+}
+
+
+/* stops the search with a given result, unless it has been stopped already */
+static void stopsearch(struct solver *s, int result, unsigned int goal) {
+  pthread_mutex_lock(&(s->stoplock));
+  if (s->stop == 0) {
+    s->stop = 1;
+    s->result = result;
+    s->goal = goal;
+  }
+  pthread_mutex_unlock(&(s->stoplock));
+}
+
+
+/* generates the children of a node that belong to the current layer, or to
+ * any later layer at the first expansion of the node. The optimal search only
+ * keeps the former: the node itself waits for the lowest layer of the others,
+ * and gets expanded again there. returns 0 on success, non-zero on out of memory */
+static int expand(struct solver *s, struct solveworker *w, unsigned int node) {
+  static const int dirstep[4] = {-16, 1, 16, -1};
+  struct atomix_bitboard board;
+  struct solveshard *shard, *nodeshard;
+  struct hashslot *slot;
+  struct solvenode *c, *n;
+  struct solvebucket *b;
+  unsigned char curpos[MAXATOMS], childpos[MAXATOMS];
+  unsigned long long curhash, childhash;
+  unsigned int child;
+  int a, i, dir, dist, cell, h, parenth, g, f, nodef, first, later, res;
+
+  memcpy(curpos, getpos(s, node), s->atomcount);
+  curhash = hashpos(s, curpos);
+  /* other threads may update the node while it is being expanded, under the lock of its shard */
+  nodeshard = &(s->shard[curhash >> 56]);
+  n = getnode(s, node);
+  pthread_mutex_lock(&(nodeshard->lock));
+  g = n->g + 1;
+  parenth = n->h;
+  pthread_mutex_unlock(&(nodeshard->lock));
+  nodef = g - 1 + s->weight * parenth;
+  first = (s->layer <= nodef);
+  later = -1;  /* lowest layer of the children left out */
+  if (s->staged == 0) parentcosts(s, w, curpos);
+  /* place the atoms of the state on the bitboard */
+  memcpy(&board, &(s->walls), sizeof(board));
+  for (a = 0; a < s->atomcount; a++) {
+    board.atoms[curpos[a] >> 4] |= 1 << (curpos[a] & 15);
+    board.atomscol[curpos[a] & 15] |= 1 << (curpos[a] >> 4);
+  }
+  /* try pushing every atom in every direction */
+  for (a = 0; a < s->atomcount; a++) {
+    for (dir = 0; dir < 4; dir++) {
+      dist = atomix_bitboard_movedistance(&board, curpos[a] & 15, curpos[a] >> 4, dir);
+      if (dist == 0) continue; /* the atom can't move that way */
+      cell = curpos[a] + dist * dirstep[dir];
+      w->generated += 1;
+      /* keep atoms of the same kind sorted, so swapping identical atoms gives the same state */
+      memcpy(childpos, curpos, s->atomcount);
+      for (i = a; (i > s->kindfirst[s->atomkind[a]]) && (childpos[i - 1] > cell); i--) childpos[i] = childpos[i - 1];
+      for (; (i + 1 < s->kindend[s->atomkind[a]]) && (childpos[i + 1] < cell); i++) childpos[i] = childpos[i + 1];
+      childpos[i] = cell;
+      childhash = curhash ^ atomix_zobristkey(s->kindval[s->atomkind[a]], curpos[a] & 15, curpos[a] >> 4) ^ atomix_zobristkey(s->kindval[s->atomkind[a]], cell & 15, cell >> 4);
+      /* the optimal search works out the layer of a child first. children of
+       * lower layers were generated already, and those of higher layers are
+       * left for later, unless the node would have to wait too long */
+      h = -1;
+      if (s->staged == 0) {
+        h = childheuristic(s, w, childpos, s->atomkind[a]);
+        if (h == DEADEND) continue;
+        if ((h != 0) && (h + 1 < parenth)) h = parenth - 1;
+        f = g + s->weight * h;
+        if ((first == 0) && (f < s->layer)) continue;
+        if ((f > s->layer) && (f - nodef < 255)) {
+          if ((later < 0) || (f < later)) later = f;
+          continue;
+        }
+      }
+      shard = &(s->shard[childhash >> 56]);
+      pthread_mutex_lock(&(shard->lock));
+      slot = hashslot(s, shard, childpos, childhash);
+      if (slot->node != NONODE) { /* known state - keep it only if we found a shorter path to it */
+          child = slot->node;
+          c = getnode(s, child);
+          if ((c->g <= g) || ((first == 0) && (g + s->weight * c->h < s->layer))) {
+            pthread_mutex_unlock(&(shard->lock));
+            continue;
+          }
+        } else {
+          if (h < 0) h = childheuristic(s, w, childpos, s->atomkind[a]);
+          if (h == DEADEND) {
+            pthread_mutex_unlock(&(shard->lock));
+            continue;
+          }
+          child = newnode(s, w, childpos);
+          if (child == NONODE) {
+            pthread_mutex_unlock(&(shard->lock));
+            return(-1);
+          }
+          c = getnode(s, child);
+          c->h = h;
+          slot->node = child;
+          shard->count += 1;
+          if ((shard->count * 2 > shard->size) && (hashgrow(s, shard) != 0)) {
+            pthread_mutex_unlock(&(shard->lock));
+            return(-1);
+          }
+      }
+      /* pathmax: a child is never more than one move closer to the goal than its parent.
+       * Always true of the lower bound, this keeps the estimate of stages consistent */
+      if ((c->h != 0) && (c->h + 1 < parenth)) c->h = parenth - 1;
+      c->parent = node;
+      c->g = g;
+      c->fdelta = 0;
+      f = g + s->weight * c->h;
+      if (f < s->layer) f = s->layer;
+      pthread_mutex_unlock(&(shard->lock));
+      /* children of the current layer are expanded right away, others wait for their layer */
+      if (f == s->layer) {
+          countadd(s, &(s->pending), 1);
+          res = dequepush(w, child);
+        } else {
+          b = getbucket(&(w->later), &(w->latersize), f);
+          if (b == NULL) return(-1);
+          res = bucketpush(b, child);
+      }
+      if (res != 0) return(-1);
+    }
+  }
+  /* wait for the layer of the children left out, unless a shorter path to the node has been found meanwhile */
+  if (later < 0) return(0);
+  pthread_mutex_lock(&(nodeshard->lock));
+  if (n->g + 1 != g) later = -1;
+  if (later >= 0) n->fdelta = later - nodef;
+  pthread_mutex_unlock(&(nodeshard->lock));
+  if (later < 0) return(0);
+  b = getbucket(&(w->later), &(w->latersize), later);
+  if ((b == NULL) || (bucketpush(b, node) != 0)) return(-1);
+  return(0);
+}
+
+
+/* expands nodes of the current layer until there are none left, or until the search is stopped */
+static void *worker_run(void *arg) {
+  struct solveworker *w = arg;
+  struct solver *s = w->s;
+  unsigned int node;
+  int i;
+  while (s->stop == 0) {
+    node = dequepop(w, 0);
+    if (node == NONODE) { /* own deque is empty, steal from the others */
+      for (i = 1; i < s->workercount; i++) {
+        node = dequepop(&(s->worker[((w - s->worker) + i) % s->workercount]), 1);
+        if (node != NONODE) {
+          w->steals += 1;
+          break;
+        }
+      }
+    }
+    if (node == NONODE) {
+      if (s->pending == 0) break; /* the layer is done */
+      sched_yield();
+      continue;
+    }
+    if (getnode(s, node)->h == 0) { /* all atoms are on a placement of the molecule */
+      stopsearch(s, ATOMIX_SOLVE_FOUND, node);
+      break;
+    }
+    if ((s->cancel != NULL) && (*(s->cancel) != 0)) {
+      stopsearch(s, ATOMIX_SOLVE_ABORTED, NONODE);
+      break;
+    }
+    if ((s->maxnodes != 0) && (countadd(s, &(s->expanded), 1) > s->maxnodes)) {
+      stopsearch(s, ATOMIX_SOLVE_ABORTED, NONODE);
+      break;
+    }
+    if ((s->maxmemory != 0) && (s->memory > s->maxmemory)) {
+      stopsearch(s, ATOMIX_SOLVE_ABORTED, NONODE);
+      break;
+    }
+    w->expanded += 1;
+    if ((getnode(s, node)->g < MAXDEPTH) && (expand(s, w, node) != 0)) {
+      stopsearch(s, ATOMIX_SOLVE_ERROR, NONODE);
+      break;
+    }
+    countadd(s, &(s->pending), -1);
+  }
+  return(NULL);
+}
+
+
+/* body of the pool threads: works on every layer handed to the pool, until the pool quits */
+static void *pool_run(void *arg) {
+  struct solveworker *w = arg;
+  struct solver *s = w->s;
+  unsigned long round = 0;
+  pthread_mutex_lock(&(s->poollock));
+  for (;;) {
+    while ((s->poolround == round) && (s->poolquit == 0)) pthread_cond_wait(&(s->poolwake), &(s->poollock));
+    if (s->poolquit != 0) break;
+    round = s->poolround;
+    pthread_mutex_unlock(&(s->poollock));
+    worker_run(w);
+    pthread_mutex_lock(&(s->poollock));
+    s->poolbusy -= 1;
+    if (s->poolbusy == 0) pthread_cond_signal(&(s->pooldone));
+  }
+  pthread_mutex_unlock(&(s->poollock));
+  return(NULL);
+}
+
+
+/* stops and joins the threads of the pool */
+static void pool_stop(struct solver *s) {
+  pthread_mutex_lock(&(s->poollock));
+  s->poolquit = 1;
+  pthread_cond_broadcast(&(s->poolwake));
+  pthread_mutex_unlock(&(s->poollock));
+  while (s->poolthreads > 0) pthread_join(s->worker[s->poolthreads--].thread, NULL);
+}
+
+
+/* reads the level layout from the game. returns 0 on success, non-zero if the level holds no molecule to build */
+static int solver_setup(struct solver *s, struct atomixgame *game, unsigned char *rootpos) {
+  unsigned char targetval[MAXATOMS], targetcell[MAXATOMS], sortedcell[MAXATOMS];
+  int x, y, i, j, k, ox, oy, valid;
+  s->targetcount = 0;
+  s->goalcount = 0;
+  s->kindcount = 0;
+  /* the root state is the packed state of the game, whose layout gives the kinds of atoms */
+  s->atomcount = atomix_packstate(game, rootpos);
+  if (s->atomcount <= 0) return(-1);
+  for (k = 0; k < 64; k++) {
+    if (game->kindlen[k] == 0) continue;
+    s->kindval[s->kindcount] = field_atom | k;
+    s->kindfirst[s->kindcount] = game->kindfirst[k];
+    s->kindend[s->kindcount] = game->kindfirst[k] + game->kindlen[k];
+    for (i = s->kindfirst[s->kindcount]; i < s->kindend[s->kindcount]; i++) s->atomkind[i] = s->kindcount;
+    s->kindcount += 1;
+  }
+  /* collect static obstacles */
+  for (y = 0; y < 16; y++) {
+    for (x = 0; x < 16; x++) {
+      s->blocked[y * 16 + x] = 1;
+      if ((game->field[x][y] & field_type) == field_free) s->blocked[y * 16 + x] = 0;
+      if ((game->field[x][y] & field_type) == field_atom) s->blocked[y * 16 + x] = 0;
+    }
+  }
+  /* collect the molecule's atoms */
+  for (y = 0; y < game->solution_height; y++) {
+    for (x = 0; x < game->solution_width; x++) {
+      if ((game->solution[x][y] & field_type) != field_atom) continue;
+      if (s->targetcount == MAXATOMS) return(-1);
+      targetval[s->targetcount] = game->solution[x][y];
+      targetcell[s->targetcount] = y * 16 + x;
+      s->targetcount += 1;
+    }
+  }
+  if (s->targetcount == 0) return(-1);
+  atomix_tobitboard(game, &(s->walls));
+  memset(s->walls.atoms, 0, sizeof(s->walls.atoms));
+  memset(s->walls.atomscol, 0, sizeof(s->walls.atomscol));
+  /* group target cells by kind as well */
+  for (i = 0; i < s->targetcount; i++) {
+    for (k = 0; k < s->kindcount; k++) if (s->kindval[k] == targetval[i]) break;
+    if (k == s->kindcount) return(1); /* the molecule needs an atom that is not there */
+  }
+  j = 0;
+  for (k = 0; k < s->kindcount; k++) {
+    s->targetfirst[k] = j;
+    for (i = 0; i < s->targetcount; i++) {
+      if (targetval[i] == s->kindval[k]) sortedcell[j++] = targetcell[i];
+    }
+    s->targetend[k] = j;
+    if (s->targetend[k] - s->targetfirst[k] > s->kindend[k] - s->kindfirst[k]) return(1); /* not enough atoms of this kind */
+  }
+  /* list all the places where the molecule could be assembled */
+  s->goals = malloc(256 * s->targetcount);
+  if (s->goals == NULL) return(-1);
+  for (oy = 0; oy <= game->field_height - game->solution_height; oy++) {
+    for (ox = 0; ox <= game->field_width - game->solution_width; ox++) {
+      valid = 1;
+      for (i = 0; i < s->targetcount; i++) {
+        if (s->blocked[sortedcell[i] + oy * 16 + ox] != 0) {
+          valid = 0;
+          break;
+        }
+      }
+      if (valid == 0) continue;
+      for (i = 0; i < s->targetcount; i++) s->goals[s->goalcount * s->targetcount + i] = sortedcell[i] + oy * 16 + ox;
+      s->goalcount += 1;
+    }
+  }
+  compute_distances(s);
+  for (i = 0; i < s->workercount; i++) {
+    s->worker[i].kindcosts = malloc(s->goalcount * s->kindcount * sizeof(int));
+    s->worker[i].placesum = malloc(s->goalcount * sizeof(int));
+    s->worker[i].placedead = malloc(s->goalcount * sizeof(int));
+    if ((s->worker[i].kindcosts == NULL) || (s->worker[i].placesum == NULL) || (s->worker[i].placedead == NULL)) return(-1);
+  }
+  return(0);
+}
+
+
+/* releases the nodes of the last search, keeping the layout of the level for the next one */
+static void solver_clear(struct solver *s) {
+  unsigned long stored = 0;
+  unsigned int i;
+  int j, f;
+  for (i = 0; i < SHARDCOUNT; i++) {
+    stored += s->shard[i].count;
+    free(s->shard[i].tab);
+    s->shard[i].tab = NULL;
+    s->shard[i].size = 0;
+    s->shard[i].count = 0;
+  }
+  if (stored > s->peakstored) s->peakstored = stored;
+  if (s->memory > s->peakmemory) s->peakmemory = s->memory;
+  for (j = 0; j < s->workercount; j++) {
+    s->worker[j].head = 0;
+    s->worker[j].tail = 0;
+    s->worker[j].chunknode = 0;
+    s->worker[j].chunkend = 0;
+    for (f = 0; f < s->worker[j].latersize; f++) s->worker[j].later[f].len = 0;
+  }
+  for (i = 0; i < s->chunkcount; i++) free(s->chunks[i]);
+  s->chunkcount = 0;
+  for (f = 0; f < s->opensize; f++) free(s->open[f].list);
+  free(s->open);
+  s->open = NULL;
+  s->opensize = 0;
+  s->memory = 0;
+}
+
+
+static void solver_free(struct solver *s) {
+  unsigned int i;
+  int j, f;
+  pool_stop(s);
+  solver_clear(s);
+  for (i = 0; i < SHARDCOUNT; i++) pthread_mutex_destroy(&(s->shard[i].lock));
+  for (j = 0; j < s->workercount; j++) {
+    free(s->worker[j].deque);
+    for (f = 0; f < s->worker[j].latersize; f++) free(s->worker[j].later[f].list);
+    free(s->worker[j].later);
+    free(s->worker[j].kindcosts);
+    free(s->worker[j].placesum);
+    free(s->worker[j].placedead);
+    pthread_mutex_destroy(&(s->worker[j].lock));
+  }
+  pthread_mutex_destroy(&(s->chunklock));
+  pthread_mutex_destroy(&(s->stoplock));
+  pthread_mutex_destroy(&(s->countlock));
+  pthread_mutex_destroy(&(s->poollock));
+  pthread_cond_destroy(&(s->poolwake));
+  pthread_cond_destroy(&(s->pooldone));
+  free(s->chunks);
+  free(s->worker);
+  free(s->goals);
+  free(s);
+}
+
+
+/* allocates the solver and its workers, and starts the pool of threads. returns NULL on failure */
+static struct solver *solver_new(int threads) {
+  struct solver *s;
+  int i;
+  s = calloc(1, sizeof(struct solver));
+  if (s == NULL) return(NULL);
+  s->workercount = threads;
+  s->worker = calloc(threads, sizeof(struct solveworker));
+  s->chunks = malloc(MAXCHUNKS * sizeof(unsigned char *));
+  if ((s->worker == NULL) || (s->chunks == NULL)) {
+    free(s->worker);
+    free(s->chunks);
+    free(s);
+    return(NULL);
+  }
+  pthread_mutex_init(&(s->chunklock), NULL);
+  pthread_mutex_init(&(s->stoplock), NULL);
+  pthread_mutex_init(&(s->countlock), NULL);
+  for (i = 0; i < threads; i++) {
+    s->worker[i].s = s;
+    pthread_mutex_init(&(s->worker[i].lock), NULL);
+  }
+  for (i = 0; i < SHARDCOUNT; i++) pthread_mutex_init(&(s->shard[i].lock), NULL);
+  pthread_mutex_init(&(s->poollock), NULL);
+  pthread_cond_init(&(s->poolwake), NULL);
+  pthread_cond_init(&(s->pooldone), NULL);
+  /* start the pool, the calling thread being the first worker */
+  for (i = 1; i < threads; i++) {
+    if (pthread_create(&(s->worker[i].thread), NULL, pool_run, &(s->worker[i])) != 0) {
+      solver_free(s);
+      return(NULL);
+    }
+    s->poolthreads += 1;
+  }
+  return(s);
+}
+
+
+/* appends the list of moves that leads from the root to 'node' to the solution */
+static int buildsolution(struct solver *s, unsigned int node, struct atomix_solution *solution) {
+  struct atomix_move *newmoves;
+  struct solvenode *n;
+  unsigned char *parentpos, *pos;
+  unsigned int id;
+  int i, j, k, len, from, to, count;
+  /* the path is counted rather than taken from g: a node reached by a shorter
+   * path gets a new parent, but its descendants keep their former g */
+  count = 0;
+  for (id = node; getnode(s, id)->parent != NONODE; id = getnode(s, id)->parent) count++;
+  if (count == 0) return(0);
+  newmoves = realloc(solution->moves, (solution->movecount + count) * sizeof(struct atomix_move));
+  if (newmoves == NULL) return(-1);
+  solution->moves = newmoves;
+  for (i = solution->movecount + count - 1; i >= solution->movecount; i--) {
+    /* the moved atom is the only one that left its cell, and states are sorted by kind, so
+     * the first difference between both states tells the kind, and the cells it left and took */
+    n = getnode(s, node);
+    parentpos = getpos(s, n->parent);
+    pos = getpos(s, node);
+    for (j = 0; parentpos[j] == pos[j]; j++);
+    k = s->atomkind[j];
+    len = s->kindend[k] - s->kindfirst[k];
+    from = 0;
+    to = 0;
+    for (j = s->kindfirst[k]; j < s->kindend[k]; j++) {
+      if (memchr(pos + s->kindfirst[k], parentpos[j], len) == NULL) from = parentpos[j];
+      if (memchr(parentpos + s->kindfirst[k], pos[j], len) == NULL) to = pos[j];
+    }
+    solution->moves[i].x = from & 15;
+    solution->moves[i].y = from >> 4;
+    if (to < from - 15) {
+        solution->moves[i].direction = 0;
+        solution->moves[i].distance = (from - to) >> 4;
+      } else if (to > from + 15) {
+        solution->moves[i].direction = 2;
+        solution->moves[i].distance = (to - from) >> 4;
+      } else if (to > from) {
+        solution->moves[i].direction = 1;
+        solution->moves[i].distance = to - from;
+      } else {
+        solution->moves[i].direction = 3;
+        solution->moves[i].distance = from - to;
+    }
+    node = n->parent;
+  }
+  solution->movecount += count;
+  return(0);
+}
+
+
+/* expands all nodes of a layer, and moves nodes generated for upcoming layers into the open list. returns 0 on success, non-zero on out of memory */
+static int runlayer(struct solver *s, struct solvebucket *layer) {
+  struct solvebucket *b;
+  struct solvenode *n;
+  unsigned long i;
+  int w, f;
+  /* deal the nodes of the layer to workers, skipping the ones that have been reached by a shorter path since */
+  s->pending = 0;
+  w = 0;
+  for (i = 0; i < layer->len; i++) {
+    n = getnode(s, layer->list[i]);
+    if (n->g + s->weight * n->h + n->fdelta != s->layer) continue;
+    if (dequepush(&(s->worker[w]), layer->list[i]) != 0) return(-1);
+    s->pending += 1;
+    w = (w + 1) % s->workercount;
+  }
+  if (s->pending == 0) return(0);
+  /* wake up the pool, and work along with it until the layer is done */
+  pthread_mutex_lock(&(s->poollock));
+  s->poolround += 1;
+  s->poolbusy = s->poolthreads;
+  pthread_cond_broadcast(&(s->poolwake));
+  pthread_mutex_unlock(&(s->poollock));
+  worker_run(&(s->worker[0]));
+  pthread_mutex_lock(&(s->poollock));
+  while (s->poolbusy > 0) pthread_cond_wait(&(s->pooldone), &(s->poollock));
+  pthread_mutex_unlock(&(s->poollock));
+  /* collect nodes for upcoming layers */
+  for (w = 0; w < s->workercount; w++) {
+    s->worker[w].head = 0;
+    s->worker[w].tail = 0;
+    for (f = 0; f < s->worker[w].latersize; f++) {
+      for (i = 0; i < s->worker[w].later[f].len; i++) {
+        b = getbucket(&(s->open), &(s->opensize), f);
+        if ((b == NULL) || (bucketpush(b, s->worker[w].later[f].list[i]) != 0)) return(-1);
+      }
+      s->worker[w].later[f].len = 0;
+    }
+  }
+  return(0);
+}
+
+
+/* searches for a goal state from rootpos, expanding layers by increasing f.
+ * returns one of the ATOMIX_SOLVE_xxx values, the goal node being s->goal.
+ * Nodes must be released with solver_clear() afterwards */
+static int solver_search(struct solver *s, unsigned char *rootpos, unsigned long maxnodes) {
+  struct solvebucket *b;
+  unsigned long long roothash;
+  unsigned int root;
+  int h, i;
+
+  s->maxnodes = maxnodes;
+  s->expanded = 0;
+  s->stop = 0;
+  s->result = ATOMIX_SOLVE_NOSOLUTION;
+  s->goal = NONODE;
+
+  /* allocate the hash table */
+  for (i = 0; i < SHARDCOUNT; i++) {
+    s->shard[i].size = 1024;
+    s->shard[i].tab = malloc(s->shard[i].size * sizeof(struct hashslot));
+    if (s->shard[i].tab == NULL) return(ATOMIX_SOLVE_ERROR);
+    memset(s->shard[i].tab, 0xFF, s->shard[i].size * sizeof(struct hashslot));
+    s->memory += s->shard[i].size * sizeof(struct hashslot);
+  }
+
+  /* insert the root node */
+  h = heuristic(s, rootpos);
+  if (h == DEADEND) return(ATOMIX_SOLVE_NOSOLUTION);
+  root = newnode(s, &(s->worker[0]), rootpos);
+  if (root == NONODE) return(ATOMIX_SOLVE_ERROR);
+  getnode(s, root)->parent = NONODE;
+  getnode(s, root)->g = 0;
+  getnode(s, root)->h = h;
+  getnode(s, root)->fdelta = 0;
+  roothash = hashpos(s, rootpos);
+  hashslot(s, &(s->shard[roothash >> 56]), rootpos, roothash)->node = root;
+  s->shard[roothash >> 56].count = 1;
+  b = getbucket(&(s->open), &(s->opensize), s->weight * h);
+  if ((b == NULL) || (bucketpush(b, root) != 0)) stopsearch(s, ATOMIX_SOLVE_ERROR, NONODE);
+
+  /* expand layers by increasing f, until a goal is met */
+  for (s->layer = s->weight * h; (s->layer < s->opensize) && (s->stop == 0); s->layer++) {
+    s->bound = s->layer;
+    if (runlayer(s, &(s->open[s->layer])) != 0) stopsearch(s, ATOMIX_SOLVE_ERROR, NONODE);
+    free(s->open[s->layer].list);
+    s->open[s->layer].list = NULL;
+    s->open[s->layer].len = 0;
+    s->open[s->layer].size = 0;
+  }
+  return(s->result);
+}
+
+
+/* looks for the next stage, and plays it on pos. returns one of the ATOMIX_SOLVE_xxx values */
+static int solve_stage(struct solver *s, unsigned char *pos, unsigned long maxnodes, struct atomix_solution *solution) {
+  unsigned char *goalcells = s->goals + s->placement * s->targetcount;
+  unsigned char filled[256];
+  int k, t, res;
+  memset(filled, 0, sizeof(filled));
+  for (k = 0; k < s->kindcount; k++) {
+    for (t = s->targetfirst[k]; t < s->targetend[k]; t++) {
+      s->required[t] = isfilled(s, pos, k, goalcells[t]);
+      if (s->required[t] != 0) filled[goalcells[t]] = 1;
+    }
+  }
+  s->rootstuck = stuckcount(s, goalcells, filled);
+  res = solver_search(s, pos, maxnodes);
+  s->spent += (s->expanded < maxnodes) ? s->expanded : maxnodes;
+  if (res == ATOMIX_SOLVE_FOUND) {
+    if (buildsolution(s, s->goal, solution) != 0) {
+        res = ATOMIX_SOLVE_ERROR;
+      } else {
+        memcpy(pos, getpos(s, s->goal), s->atomcount);
+    }
+  }
+  solver_clear(s);
+  return(res);
+}
+
+
+/* lists the empty targets of the placement being built, hardest to fill first:
+ * the ones atoms can't reach stopping against walls only come last. returns
+ * the number of targets listed */
+static int stagetargets(struct solver *s, unsigned char *pos, int *list) {
+  unsigned char *goalcells = s->goals + s->placement * s->targetcount;
+  unsigned char d[256], queue[256];
+  int cost[MAXATOMS];
+  int k, t, a, i, j, n = 0, qhead, qtail, cell, next, last, dir, c;
+  for (k = 0; k < s->kindcount; k++) {
+    for (t = s->targetfirst[k]; t < s->targetend[k]; t++) {
+      if (isfilled(s, pos, k, goalcells[t]) != 0) continue;
+      list[n] = t;
+      cost[n] = STAGEFAR;
+      for (a = s->kindfirst[k]; a < s->kindend[k]; a++) {
+        /* moves of the atom if nothing but walls could stop it */
+        memset(d, 255, sizeof(d));
+        d[pos[a]] = 0;
+        qhead = 0;
+        qtail = 0;
+        queue[qtail++] = pos[a];
+        while (qhead < qtail) {
+          cell = queue[qhead++];
+          for (dir = 0; dir < 4; dir++) {
+            last = -1;
+            for (next = nextcell(cell, dir); (next >= 0) && (s->blocked[next] == 0); next = nextcell(next, dir)) last = next;
+            if ((last < 0) || (d[last] != 255)) continue;
+            d[last] = d[cell] + 1;
+            queue[qtail++] = last;
+          }
+        }
+        c = d[goalcells[t]];
+        if (c == 255) c = 100 + s->dist[pos[a]][goalcells[t]];
+        if (c < cost[n]) cost[n] = c;
+      }
+      n++;
+    }
+  }
+  for (i = 0; i < n; i++) {
+    for (j = i + 1; j < n; j++) {
+      if (cost[j] <= cost[i]) continue;
+      c = cost[i];
+      cost[i] = cost[j];
+      cost[j] = c;
+      c = list[i];
+      list[i] = list[j];
+      list[j] = c;
+    }
+  }
+  return(n);
+}
+
+
+/* builds the molecule on the current placement, stage by stage, from rootpos.
+ * Targets are tried in turn, the ones this placement got stuck on before
+ * (prio) first, and then any target at all, giving stages more nodes as long
+ * as none succeeds. returns ATOMIX_SOLVE_FOUND once the molecule is built,
+ * the moves being appended to the solution */
+static int solve_placement(struct solver *s, unsigned char *rootpos, unsigned char *prio, unsigned long maxnodes, struct atomix_solution *solution) {
+  unsigned char pos[MAXATOMS];
+  unsigned long budget = STAGENODES, limit;
+  int list[MAXATOMS], cand[MAXATOMS + 1];
+  int n, count, i, j, c, res;
+  memcpy(pos, rootpos, s->atomcount);
+  for (;;) {
+    n = stagetargets(s, pos, list);
+    if (n == 0) return(ATOMIX_SOLVE_FOUND);
+    /* targets pushed by former failures first, most pushed first, then any target */
+    count = 0;
+    for (i = 0; i < n; i++) {
+      if (prio[list[i]] == 0) continue;
+      for (j = count; (j > 0) && (prio[cand[j - 1]] < prio[list[i]]); j--) cand[j] = cand[j - 1];
+      cand[j] = list[i];
+      count++;
+    }
+    cand[count++] = -1;
+    /* every candidate is tried with the relaxed estimate, and then with a closer look */
+    res = ATOMIX_SOLVE_NOSOLUTION;
+    for (c = 0; (c < count * 2) && (res != ATOMIX_SOLVE_FOUND); c++) {
+      limit = budget;
+      if ((s->cancel != NULL) && (*(s->cancel) != 0)) return(ATOMIX_SOLVE_ABORTED);
+      if (maxnodes != 0) {
+        if (s->spent >= maxnodes) return(ATOMIX_SOLVE_ABORTED);
+        if (maxnodes - s->spent < limit) limit = maxnodes - s->spent;
+      }
+      s->nexttarget = cand[c % count];
+      s->guided = (c >= count);
+      res = solve_stage(s, pos, limit, solution);
+      if (res == ATOMIX_SOLVE_ERROR) return(res);
+    }
+    if (res == ATOMIX_SOLVE_FOUND) continue;
+    if (budget < STAGENODES * STAGEGROWTH) {
+      budget *= 4;
+      continue;
+    }
+    /* give up for now, but try these targets first next time */
+    for (i = 0; i < n; i++) {
+      if (prio[list[i]] < 255) prio[list[i]] += 1;
+    }
+    return(ATOMIX_SOLVE_NOSOLUTION);
+  }
+}
+
+
+/* finds some solution, not necessarily the shortest one, building the
+ * molecule stage by stage. Placements are tried from the easiest to the
+ * hardest, and again as long as failures tell which targets should come first */
+static int solve_staged(struct solver *s, unsigned char *rootpos, unsigned long maxnodes, struct atomix_solution *solution) {
+  unsigned char filled[256];
+  unsigned char *prio, *goalcells;
+  int *order, *cost;
+  int goal, run, i, k, t, c, res = ATOMIX_SOLVE_NOSOLUTION;
+  prio = calloc(s->goalcount, s->targetcount);
+  order = malloc(s->goalcount * sizeof(int));
+  cost = malloc(s->goalcount * sizeof(int));
+  if ((prio == NULL) || (order == NULL) || (cost == NULL)) {
+    free(prio);
+    free(order);
+    free(cost);
+    return(ATOMIX_SOLVE_ERROR);
+  }
+  /* sort placements by targets walled off already, and then by relaxed cost */
+  for (goal = 0; goal < s->goalcount; goal++) {
+    goalcells = s->goals + goal * s->targetcount;
+    memset(filled, 0, sizeof(filled));
+    for (k = 0; k < s->kindcount; k++) {
+      for (t = s->targetfirst[k]; t < s->targetend[k]; t++) {
+        if (isfilled(s, rootpos, k, goalcells[t]) != 0) filled[goalcells[t]] = 1;
+      }
+    }
+    cost[goal] = placementcost(s, rootpos, goalcells, DEADEND);
+    if (cost[goal] != DEADEND) cost[goal] += stuckcount(s, goalcells, filled) * 256;
+    for (i = goal; (i > 0) && (cost[order[i - 1]] > cost[goal]); i--) order[i] = order[i - 1];
+    order[i] = goal;
+  }
+  s->staged = 1;
+  s->weight = STAGEWEIGHT;
+  s->spent = 0;
+  for (run = 0; (run < STAGERUNS) && (res == ATOMIX_SOLVE_NOSOLUTION); run++) {
+    for (i = 0; (i < s->goalcount) && (res == ATOMIX_SOLVE_NOSOLUTION); i++) {
+      if (cost[order[i]] == DEADEND) break;
+      s->placement = order[i];
+      c = solution->movecount;
+      res = solve_placement(s, rootpos, prio + order[i] * s->targetcount, maxnodes, solution);
+      if (res == ATOMIX_SOLVE_FOUND) break;
+      /* drop the moves of the stages that led nowhere */
+      solution->movecount = c;
+    }
+  }
+  s->staged = 0;
+  s->weight = 1;
+  free(prio);
+  free(order);
+  free(cost);
+  return(res);
+}
+
+
+int atomix_solve_parallel(struct atomixgame *game, int threads, unsigned long maxnodes, int flags, volatile int *cancel, struct atomix_solution *solution) {
+  struct solver *s;
+  unsigned char rootpos[MAXATOMS];
+  int res, i;
+  struct timeval starttime, endtime;
+
+  gettimeofday(&starttime, NULL);
+  if (threads < 1) threads = 1;
+  if (threads > ATOMIX_MAXTHREADS) threads = ATOMIX_MAXTHREADS;
+  memset(solution, 0, sizeof(struct atomix_solution));
+  solution->threads = threads;
+
+  s = solver_new(threads);
+  if (s == NULL) return(ATOMIX_SOLVE_ERROR);
+  res = solver_setup(s, game, rootpos);
+  if (res != 0) {
+    solver_free(s);
+    if (res > 0) return(ATOMIX_SOLVE_NOSOLUTION);
+    return(ATOMIX_SOLVE_ERROR);
+  }
+  s->maxmemory = solvememory;
+  s->cancel = cancel;
+  s->weight = 1;
+
+  /* look for the shortest solution first */
+  res = solver_search(s, rootpos, maxnodes);
+  solution->lowerbound = s->bound;
+  if (res == ATOMIX_SOLVE_FOUND) {
+    solution->optimal = 1;
+    if (buildsolution(s, s->goal, solution) != 0) res = ATOMIX_SOLVE_ERROR;
+  }
+  solver_clear(s);
+  /* too big for that, settle for any solution within the same number of nodes if allowed to */
+  if ((res == ATOMIX_SOLVE_ABORTED) && (flags & ATOMIX_SOLVE_ANYSOLUTION)) {
+    res = solve_staged(s, rootpos, maxnodes, solution);
+    if ((res == ATOMIX_SOLVE_FOUND) && (solution->movecount <= solution->lowerbound)) solution->optimal = 1;
+    if (res != ATOMIX_SOLVE_FOUND) {
+      free(solution->moves);
+      solution->moves = NULL;
+      solution->movecount = 0;
+      if (res == ATOMIX_SOLVE_NOSOLUTION) res = ATOMIX_SOLVE_ABORTED; /* the stages simply gave up */
+    }
+  }
+
+  /* fill in statistics */
+  for (i = 0; i < threads; i++) {
+    solution->threadexpanded[i] = s->worker[i].expanded;
+    solution->threadsteals[i] = s->worker[i].steals;
+    solution->expanded += s->worker[i].expanded;
+    solution->generated += s->worker[i].generated;
+  }
+  solution->stored = s->peakstored;
+  solution->memory = s->peakmemory;
+  gettimeofday(&endtime, NULL);
+  solution->seconds = (endtime.tv_sec - starttime.tv_sec) + (endtime.tv_usec - starttime.tv_usec) / 1000000.0;
+
+  solver_free(s);
+  return(res);
+}
+
+
+/* sets the max number of bytes a single search may use (0 for no limit) */
+void atomix_setsolvememory(unsigned long maxbytes) {
+  solvememory = maxbytes;
+}
+
+
+int atomix_solve(struct atomixgame *game, unsigned long maxnodes, struct atomix_solution *solution) {
+  return(atomix_solve_parallel(game, 1, maxnodes, 0, NULL, solution));
+}
+
+
+/* frees the memory held by a solution */
+void atomix_freesolution(struct atomix_solution *solution) {
+  free(solution->moves);
+  solution->moves = NULL;
+  solution->movecount = 0;
+}
@@ -0,0 +1,94 @@
+/*
+ * This is part of the Atomiks project.
+ * Copyright (C) Mateusz Viste 2013, 2014, 2015
+ *
+ * Finds optimal solutions to Atomix levels, using an A* search over the
+ * positions of the atoms on the playfield. Levels too big for that can get
+ * a solution that may not be optimal, if the caller asks for it.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef atomsolve_h_sentinel
+#define atomsolve_h_sentinel
+
+  #define ATOMIX_SOLVE_FOUND 1
+  #define ATOMIX_SOLVE_NOSOLUTION 0
+  #define ATOMIX_SOLVE_ABORTED -1  /* the node or memory limit has been reached, or the search was cancelled */
+  #define ATOMIX_SOLVE_ERROR -2    /* out of memory, or the level has no molecule */
+
+  #define ATOMIX_MAXTHREADS 64
+
+  /* flags of atomix_solve_parallel() */
+  #define ATOMIX_SOLVE_ANYSOLUTION 1  /* settle for a solution that may not be the shortest, if the shortest is out of reach */
+
+  /* default memory limit of a search, see atomix_setsolvememory() */
+  #ifdef __GCW0__
+    #define ATOMIX_SOLVE_DEFMEMORY (64ul * 1024 * 1024)
+  #else
+    #define ATOMIX_SOLVE_DEFMEMORY (1024ul * 1024 * 1024)
+  #endif
+
+  struct atomixgame;
+
+  struct atomix_move {
+    unsigned char x;          /* position of the atom before the move */
+    unsigned char y;
+    unsigned char direction;  /* 0: up / 1: right / 2: down / 3: left */
+    unsigned char distance;   /* how many cells the atom travels */
+  };
+
+  struct atomix_solution {
+    int movecount;
+    struct atomix_move *moves;  /* movecount moves, NULL if no solution */
+    int optimal;                /* non-zero if no solution is shorter */
+    int lowerbound;             /* no solution is shorter than this many moves */
+    unsigned long expanded;     /* number of states expanded by the search */
+    unsigned long generated;    /* number of states generated by the search */
+    unsigned long stored;       /* number of distinct states kept in memory */
+    unsigned long memory;       /* bytes used by the stored states and their hash table */
+    double seconds;             /* wall-clock time spent on the search */
+    int threads;                /* number of threads that took part in the search */
+    unsigned long threadexpanded[ATOMIX_MAXTHREADS]; /* states expanded by every thread */
+    unsigned long threadsteals[ATOMIX_MAXTHREADS];   /* states every thread stole from other threads */
+  };
+
+  /* looks for the shortest sequence of moves that assembles the molecule,
+   * starting from the current state of the playfield. maxnodes is the max
+   * number of states to expand (0 for no limit), a state expanded again on a
+   * later layer counting again. returns one of the
+   * ATOMIX_SOLVE_xxx values, ATOMIX_SOLVE_ABORTED if the shortest solution
+   * can't be found within that many states, or within the memory limit. The
+   * solution struct is always filled, and must be released with
+   * atomix_freesolution() afterwards. */
+  int atomix_solve(struct atomixgame *game, unsigned long maxnodes, struct atomix_solution *solution);
+
+  /* same as atomix_solve(), but spreads the search over 'threads' threads
+   * (up to ATOMIX_MAXTHREADS). The length of the solution found does not
+   * depend on the number of threads, although the moves themselves might.
+   * With ATOMIX_SOLVE_ANYSOLUTION in flags, if the shortest solution is out
+   * of reach, the solver spends as many states again looking for any
+   * solution, that is then returned with the optimal flag left unset.
+   * cancel may point to a flag another thread sets to stop the search early,
+   * which then returns ATOMIX_SOLVE_ABORTED (NULL if not needed). */
+  int atomix_solve_parallel(struct atomixgame *game, int threads, unsigned long maxnodes, int flags, volatile int *cancel, struct atomix_solution *solution);
+
+  /* sets the max number of bytes of memory the states of a single search
+   * may take (0 for no limit). ATOMIX_SOLVE_DEFMEMORY by default */
+  void atomix_setsolvememory(unsigned long maxbytes);
+
+  /* frees the memory held by a solution */
+  void atomix_freesolution(struct atomix_solution *solution);
+
+#endif
@@ -0,0 +1,113 @@
+/*
+ * This is part of the Atomiks project.
+ * Copyright (C) Mateusz Viste 2013, 2014, 2015
+ *
+ * Transposition table: a fixed-size cache that maps zobrist hashes of game
+ * states to 64 bits of data, to be shared by any code searching through
+ * game states.
+ *
+ * The table never grows: entries are grouped in buckets of four (one cache
+ * line), and a full bucket evicts one of its entries. Every entry stores
+ * its key xor-ed with its data, so an entry torn by two threads writing it
+ * at the same time simply fails to match on the next probe. This lets
+ * several threads share one table without any lock.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>  /* malloc(), free() */
+#include <string.h>  /* memset() */
+#include "atomtt.h"  /* include self for control */
+
+#define BUCKETSIZE 4
+
+struct ttentry {
+  unsigned long long check;  /* hash ^ data */
+  unsigned long long data;
+};
+
+struct atomix_tt {
+  struct ttentry *entries;
+  unsigned long bucketmask;  /* number of buckets, minus one */
+};
+
+
+/* allocates a table able to hold about 'entries' entries (rounded down to
+ * a power of two). returns NULL on out of memory. */
+struct atomix_tt *atomix_tt_new(unsigned long entries) {
+  struct atomix_tt *tt;
+  unsigned long buckets = 1;
+  while (buckets * 2 * BUCKETSIZE <= entries) buckets *= 2;
+  tt = malloc(sizeof(struct atomix_tt));
+  if (tt == NULL) return(NULL);
+  tt->entries = malloc(buckets * BUCKETSIZE * sizeof(struct ttentry));
+  if (tt->entries == NULL) {
+    free(tt);
+    return(NULL);
+  }
+  tt->bucketmask = buckets - 1;
+  atomix_tt_clear(tt);
+  return(tt);
+}
+
+
+/* frees a table */
+void atomix_tt_free(struct atomix_tt *tt) {
+  if (tt == NULL) return;
+  free(tt->entries);
+  free(tt);
+}
+
+
+/* forgets all entries of a table */
+void atomix_tt_clear(struct atomix_tt *tt) {
+  memset(tt->entries, 0, (tt->bucketmask + 1) * BUCKETSIZE * sizeof(struct ttentry));
+}
+
+
+/* looks up a hash. returns 1 and fills *data if found, 0 otherwise */
+int atomix_tt_probe(struct atomix_tt *tt, unsigned long long hash, unsigned long long *data) {
+  struct ttentry *bucket;
+  unsigned long long d;
+  int i;
+  bucket = tt->entries + (hash & tt->bucketmask) * BUCKETSIZE;
+  for (i = 0; i < BUCKETSIZE; i++) {
+    d = bucket[i].data;
+    if ((bucket[i].check == 0) && (d == 0)) continue; /* free slot */
+    if ((bucket[i].check ^ d) == hash) {
+      *data = d;
+      return(1);
+    }
+  }
+  return(0);
+}
+
+
+/* stores data under a hash, evicting an older entry if the bucket is full */
+void atomix_tt_store(struct atomix_tt *tt, unsigned long long hash, unsigned long long data) {
+  struct ttentry *bucket;
+  int i, victim = -1;
+  bucket = tt->entries + (hash & tt->bucketmask) * BUCKETSIZE;
+  for (i = 0; i < BUCKETSIZE; i++) {
+    if ((bucket[i].check ^ bucket[i].data) == hash) { /* update the existing entry */
+      victim = i;
+      break;
+    }
+    if ((victim < 0) && (bucket[i].check == 0) && (bucket[i].data == 0)) victim = i; /* free slot */
+  }
+  /* bucket full: pick a victim using hash bits that did not select the bucket */
+  if (victim < 0) victim = (hash >> 60) & (BUCKETSIZE - 1);
+  bucket[victim].data = data;
+  bucket[victim].check = hash ^ data;
+}
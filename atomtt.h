@@ -0,0 +1,44 @@
+/*
+ * This is part of the Atomiks project.
+ * Copyright (C) Mateusz Viste 2013, 2014, 2015
+ *
+ * Transposition table: a fixed-size cache that maps zobrist hashes of game
+ * states to 64 bits of data, to be shared by any code searching through
+ * game states.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef atomtt_h_sentinel
+#define atomtt_h_sentinel
+
+  struct atomix_tt;
+
+  /* allocates a table able to hold about 'entries' entries (rounded down to
+   * a power of two). returns NULL on out of memory. */
+  struct atomix_tt *atomix_tt_new(unsigned long entries);
+
+  /* frees a table */
+  void atomix_tt_free(struct atomix_tt *tt);
+
+  /* forgets all entries of a table */
+  void atomix_tt_clear(struct atomix_tt *tt);
+
+  /* looks up a hash. returns 1 and fills *data if found, 0 otherwise */
+  int atomix_tt_probe(struct atomix_tt *tt, unsigned long long hash, unsigned long long *data);
+
+  /* stores data under a hash, evicting an older entry if the bucket is full */
+  void atomix_tt_store(struct atomix_tt *tt, unsigned long long hash, unsigned long long data);
+
+#endif
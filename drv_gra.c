@@ -5,12 +5,14 @@
 
 
 #include <stdio.h>    /* puts(), printf() */
-#include <stdlib.h>   /* malloc(), free() */
+#include <stdlib.h>   /* malloc(), calloc(), free() */
+#include <string.h>   /* memcpy(), memmove(), memcmp() */
 #include <SDL2/SDL.h>
 
 #include "drv_gra.h" /* include self for control */
 
 #include "gz.h"
+#include "prof.h"
 
 #ifdef __GCW0__
 #define SCALE 1
@@ -18,53 +20,781 @@
 #define SCALE 2
 #endif
 
+/* sprites are packed into a few big atlas textures, so drawing them does not
+ * require switching textures all the time */
+#define ATLAS_SIZE 1024
+#define ATLAS_MAXPAGES 8
+
+/* max number of sprites queued between gra_begin_batch() and gra_end_batch()
+ * before they get drawn */
+#define BATCH_MAXQUADS 512
+
+/* max number of separate damaged regions tracked between two refreshes. past
+ * that, they are all merged into one */
+#define DIRTY_MAXRECTS 32
+
+/* max number of drawing operations of a frame that are remembered, to find
+ * out what changed from the last frame. past that, the frame is damaged whole */
+#define FRAME_MAXOPS 1024
+
+/* max number of images queued by gra_predecode(), and of threads decoding them */
+#define PREDECODE_MAX 64
+#define PREDECODE_MAXTHREADS 16
+
+/* max number of sprites loaded on demand by loadgzbmp() */
+#define LAZY_MAX 64
+
+/* states of a queued image */
+#define PREDECODE_QUEUED 0
+#define PREDECODE_READY 1
+#define PREDECODE_TAKEN 2
+
+/* files of the texture cache: magic, width, height and pixel format, all
+ * 32 bit little-endian, then the pixels. the magic changes whenever the way
+ * pixels are converted does */
+#define TEXCACHE_MAGIC "ATMKTEX2"
+#define TEXCACHE_HEADERLEN 20
+
+/* bmp files are decompressed that many bytes into their buffer, so the pixels
+ * that follow the usual 54 bytes of headers land on a 4-bytes boundary */
+#define BMP_ALIGNPAD 2
+
 struct gra_sprite {
-  SDL_Texture *ptr;
+  SDL_Texture *ptr;  /* the atlas page holding the sprite */
+  int x;             /* position of the sprite within the page */
+  int y;
   int w;
   int h;
+  int texw;          /* size of the texture */
+  int texh;
+  int texscale;      /* texture pixels per sprite pixel (SCALE for layers, 1 otherwise) */
+  unsigned char *memgz;  /* gziped image of a sprite loaded on demand, NULL for other sprites */
+  long memgzlen;
+  unsigned long lastuse; /* refresh a sprite loaded on demand has been drawn last at */
+};
+
+struct batchquad {
+  SDL_Texture *texture;
+  int texw;
+  int texh;
+  SDL_Rect src;
+  SDL_Rect dst;
+};
+
+/* a drawing operation, as remembered to tell what changed from a frame to the next */
+struct frameop {
+  SDL_Texture *texture;  /* NULL for rectangles */
+  SDL_Rect src;          /* for rectangles: the color, alpha and fill flag */
+  SDL_Rect dst;
+};
+
+struct predecoded {
+  unsigned char *memgz;
+  long memgzlen;
+  SDL_Surface *surface;  /* the decoded image, once READY */
+  int state;
+};
+
+struct atlaspage {
+  SDL_Texture *texture;
+  int shelfx;        /* next free position on the current shelf */
+  int shelfy;        /* top of the current shelf */
+  int shelfh;        /* height of the current shelf */
 };
 
 static SDL_Window *window = NULL;
 static SDL_Renderer *renderer = NULL;
+static SDL_Surface *offscreen = NULL;  /* the screen of the headless mode, instead of a window */
+static struct atlaspage atlas[ATLAS_MAXPAGES];
+static int atlaspages = 0;
+static struct batchquad batch[BATCH_MAXQUADS];
+static int batchlen = 0;
+static int batching = 0;
+/* with renderers that keep the window content between frames, everything is
+ * drawn into a backbuffer texture, and only the regions that changed since the
+ * last refresh are copied to the window. other renderers draw to the window
+ * directly, and show whole frames */
+static SDL_Texture *backbuffer = NULL;
+static int screenw, screenh;
+static SDL_Rect dirty[DIRTY_MAXRECTS];
+static int dirtycount = 0;
+static int drawtolayer = 0;
+static int keepsframe = 0;    /* the window content survives a present (software renderer) */
+/* the drawing operations of the last frame and of the current one. frames
+ * that start with gra_clear() are compared operation by operation, and only
+ * the operations that differ damage the screen */
+static struct frameop frameops[2][FRAME_MAXOPS];
+static int frameopcount[2] = {0, 0};
+static int framecleared[2] = {0, 0};  /* the frame started with gra_clear() */
+static int framecur = 0;
+static int windowreset = 1;   /* the window content is lost, it has to be copied whole */
+static int vsync = 0;         /* presents wait for the vertical retrace */
+static SDL_Texture *lasttexture = NULL;  /* last texture drawn from, to count switches */
+/* pixel format of the textures: the renderer's own, so uploads need no
+ * conversion, as long as it has 32 bit pixels with alpha */
+static Uint32 texformat = SDL_PIXELFORMAT_RGBA8888;
+/* sprites loaded on demand, and the memory used by the textures of those that
+ * are loaded */
+static struct gra_sprite *lazy[LAZY_MAX];
+static int lazycount = 0;
+static long lazybytes = 0;
+static long lazybudget = 0;       /* max for lazybytes, 0 for no limit */
+static unsigned long refreshes = 0;
+static char *cachedir = NULL;     /* where the texture cache lives, NULL if disabled */
+/* images decoded in the background by a pool of threads. the pool is started
+ * by the first gra_predecode(), and stopped once all images are taken */
+static struct predecoded predecoded[PREDECODE_MAX];
+static int predecodedcount = 0;  /* images queued so far */
+static int predecodenext = 0;    /* next image a thread will decode */
+static int predecodetaken = 0;   /* images taken by loadgzbmp() and loadSpriteSheet() */
+static int predecodequit = 0;
+static SDL_Thread *predecodepool[PREDECODE_MAXTHREADS];
+static int predecodethreads = 0;
+static SDL_mutex *predecodelock = NULL;  /* protects everything above */
+static SDL_cond *predecodework = NULL;   /* an image got queued */
+static SDL_cond *predecodeready = NULL;  /* an image got decoded */
+
+
+/* reads a little-endian 16 or 32 bit value of a bmp header */
+static unsigned int bmp_read16(unsigned char *p) {
+  return(p[0] | p[1] << 8);
+}
+
+static Uint32 bmp_read32(unsigned char *p) {
+  return(p[0] | p[1] << 8 | p[2] << 16 | (Uint32)p[3] << 24);
+}
+
+
+/* turns the bmp file held in buff (at bmp) into a surface using the very same
+ * memory for its pixels, if it is an uncompressed 8 or 32 bit bmp. the rows
+ * are put top-down in place. returns NULL if the bmp is of any other kind */
+static SDL_Surface *bmp_surface_inplace(unsigned char *buff, unsigned char *bmp, long bmplen) {
+  SDL_Surface *res;
+  SDL_Color palette[256];
+  unsigned char *pixels, *row, *p;
+  long offset, i;
+  int w, h, bpp, pitch, y, hdrsize, colorcount, topdown = 0;
+  if ((bmplen < 54) || (bmp[0] != 'B') || (bmp[1] != 'M')) return(NULL);
+  offset = bmp_read32(bmp + 10);
+  hdrsize = bmp_read32(bmp + 14);
+  w = (Sint32)bmp_read32(bmp + 18);
+  h = (Sint32)bmp_read32(bmp + 22);
+  bpp = bmp_read16(bmp + 28);
+  if ((hdrsize < 40) || (bmp_read16(bmp + 26) != 1) || (bmp_read32(bmp + 30) != 0)) return(NULL);
+  if ((bpp != 8) && (bpp != 32)) return(NULL);
+  if (h < 0) {
+    h = -h;
+    topdown = 1;
+  }
+  if ((w <= 0) || (h == 0) || (w > 16384) || (h > 16384)) return(NULL);
+  pitch = ((w * bpp / 8) + 3) & ~3;
+  if ((offset < 14 + hdrsize) || (offset + (long)pitch * h > bmplen)) return(NULL);
+  pixels = bmp + offset;
+  /* 32 bit pixels must be aligned. if the headers are of an unusual size,
+   * move the pixels back over them */
+  if ((bpp == 32) && (((size_t)pixels & 3) != 0)) {
+    p = pixels;
+    pixels = buff + ((pixels - buff) & ~3);
+    memmove(pixels, p, (size_t)pitch * h);
+  }
+  /* SDL surfaces are top-down, bmp files usually are bottom-up */
+  if (topdown == 0) {
+    row = malloc(pitch);
+    if (row == NULL) return(NULL);
+    for (y = 0; y < h / 2; y++) {
+      memcpy(row, pixels + (long)y * pitch, pitch);
+      memcpy(pixels + (long)y * pitch, pixels + (long)(h - 1 - y) * pitch, pitch);
+      memcpy(pixels + (long)(h - 1 - y) * pitch, row, pitch);
+    }
+    free(row);
+  }
+  if (bpp == 32) {
+    res = SDL_CreateRGBSurfaceFrom(pixels, w, h, 32, pitch, 0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000);
+    if (res == NULL) return(NULL);
+    /* like SDL_LoadBMP(), consider a 32 bit bmp with no alpha at all as opaque */
+    for (i = 3; i < (long)pitch * h; i += 4) if (pixels[i] != 0) break;
+    if (i >= (long)pitch * h) {
+      for (i = 3; i < (long)pitch * h; i += 4) pixels[i] = 0xFF;
+    }
+    return(res);
+  }
+  /* 8 bit bmp: load the palette, stored right after the headers */
+  colorcount = bmp_read32(bmp + 46);
+  if ((colorcount == 0) || (colorcount > 256)) colorcount = 256;
+  if (14 + hdrsize + colorcount * 4 > offset) return(NULL);
+  for (i = 0; i < colorcount; i++) {
+    p = bmp + 14 + hdrsize + (i * 4);
+    palette[i].r = p[2];
+    palette[i].g = p[1];
+    palette[i].b = p[0];
+    palette[i].a = 255;
+  }
+  res = SDL_CreateRGBSurfaceFrom(pixels, w, h, 8, pitch, 0, 0, 0, 0);
+  if (res == NULL) return(NULL);
+  SDL_SetPaletteColors(res->format->palette, palette, 0, colorcount);
+  return(res);
+}
 
 
-/* loads a gziped bmp image from memory into a SDL surface */
+/* returns the length of a bmp image in memory, gziped or not */
+static long gzbmp_len(unsigned char *memgz, long memgzlen) {
+  if (isGz(memgz, memgzlen) == 0) return(memgzlen);
+  return(ungz_len(memgz, memgzlen));
+}
+
+
+/* copies the first destlen bytes of a bmp image in memory into dest,
+ * decompressing them if the image is gziped. returns 0 on success */
+static int gzbmp_read(unsigned char *memgz, long memgzlen, unsigned char *dest, long destlen) {
+  if (isGz(memgz, memgzlen) != 0) return(ungz_into(memgz, memgzlen, dest, destlen));
+  if (destlen > memgzlen) return(-1);
+  memcpy(dest, memgz, destlen);
+  return(0);
+}
+
+
+/* loads a bmp image from memory, gziped or not, into a SDL surface. the image
+ * gets decompressed straight into the memory that holds the pixels of the
+ * surface. the surface must be released with freegzbmp_surface() */
 static SDL_Surface *loadgzbmp_surface(unsigned char *memgz, long memgzlen) {
-  unsigned char *rawimage;
-  long rawimagelen;
+  unsigned char *buff, *bmp;
+  long bmplen;
   SDL_Surface *res;
   SDL_RWops *rwop;
-  if (isGz(memgz, memgzlen) == 0) return(NULL);
-  rawimage = ungz(memgz, memgzlen, &rawimagelen);
-  rwop = SDL_RWFromMem(rawimage, rawimagelen);
+  bmplen = gzbmp_len(memgz, memgzlen);
+  if (bmplen <= 0) return(NULL);
+  buff = malloc(bmplen + BMP_ALIGNPAD);
+  if (buff == NULL) return(NULL);
+  bmp = buff + BMP_ALIGNPAD;
+  if (gzbmp_read(memgz, memgzlen, bmp, bmplen) != 0) {
+    free(buff);
+    return(NULL);
+  }
+  res = bmp_surface_inplace(buff, bmp, bmplen);
+  if (res != NULL) { /* the surface owns buff from now on */
+    res->userdata = buff;
+    return(res);
+  }
+  /* any other kind of bmp is left to SDL */
+  rwop = SDL_RWFromMem(bmp, bmplen);
   res = SDL_LoadBMP_RW(rwop, 0);
   SDL_FreeRW(rwop);
-  free(rawimage);
+  free(buff);
+  if (res != NULL) res->userdata = NULL;
+  return(res);
+}
+
+
+/* frees a surface returned by loadgzbmp_surface() */
+static void freegzbmp_surface(SDL_Surface *surface) {
+  void *buff;
+  if (surface == NULL) return;
+  buff = surface->userdata;
+  SDL_FreeSurface(surface);
+  if (buff != NULL) free(buff);
+}
+
+
+/* returns a hash of the content of an image in memory. gziped images carry
+ * the crc32 of their content in their trailer, others get hashed (FNV-1a) */
+static Uint32 gzbmp_hash(unsigned char *memgz, long memgzlen) {
+  Uint32 res = 2166136261u;
+  long i;
+  if (isGz(memgz, memgzlen) != 0) return(bmp_read32(memgz + memgzlen - 8));
+  for (i = 0; i < memgzlen; i++) res = (res ^ memgz[i]) * 16777619u;
   return(res);
 }
 
 
+static void write32(FILE *fd, Uint32 v) {
+  putc(v & 0xff, fd);
+  putc((v >> 8) & 0xff, fd);
+  putc((v >> 16) & 0xff, fd);
+  putc((v >> 24) & 0xff, fd);
+}
+
+
+/* loads pixels from a file of the texture cache. returns NULL if the file
+ * is not there, or not valid */
+static SDL_Surface *texcache_load(char *filename) {
+  FILE *fd;
+  SDL_Surface *res = NULL;
+  unsigned char header[TEXCACHE_HEADERLEN];
+  unsigned char *pixels = NULL;
+  long w, h;
+  Uint32 rmask, gmask, bmask, amask;
+  int bpp;
+  if (SDL_PixelFormatEnumToMasks(texformat, &bpp, &rmask, &gmask, &bmask, &amask) == SDL_FALSE) return(NULL);
+  fd = fopen(filename, "rb");
+  if (fd == NULL) return(NULL);
+  if ((fread(header, 1, TEXCACHE_HEADERLEN, fd) == TEXCACHE_HEADERLEN) && (memcmp(header, TEXCACHE_MAGIC, 8) == 0) && (bmp_read32(header + 16) == texformat)) {
+    w = bmp_read32(header + 8);
+    h = bmp_read32(header + 12);
+    if ((w > 0) && (h > 0) && (w <= 16384) && (h <= 16384)) pixels = malloc(w * h * 4);
+    /* the file must hold all the pixels, and nothing more */
+    if ((pixels != NULL) && (fread(pixels, 4, w * h, fd) == (size_t)(w * h)) && (getc(fd) == EOF)) {
+      res = SDL_CreateRGBSurfaceFrom(pixels, w, h, bpp, w * 4, rmask, gmask, bmask, amask);
+    }
+  }
+  fclose(fd);
+  if (res == NULL) {
+    if (pixels != NULL) free(pixels);
+    return(NULL);
+  }
+  res->userdata = pixels;  /* freegzbmp_surface() frees it */
+  return(res);
+}
+
+
+/* saves the pixels of a surface in the texture format into a file of the
+ * texture cache. the file is written under a temporary name and renamed
+ * once complete, so other runs never see it half written */
+static void texcache_save(char *filename, SDL_Surface *surface) {
+  FILE *fd;
+  char tmpname[4096];
+  int y, ok = 1;
+  if (snprintf(tmpname, sizeof(tmpname), "%s.%lx.tmp", filename, (unsigned long)SDL_ThreadID()) >= (int)sizeof(tmpname)) return;
+  fd = fopen(tmpname, "wb");
+  if (fd == NULL) return;
+  fwrite(TEXCACHE_MAGIC, 1, 8, fd);
+  write32(fd, surface->w);
+  write32(fd, surface->h);
+  write32(fd, texformat);
+  for (y = 0; y < surface->h; y++) {
+    if (fwrite((unsigned char *)surface->pixels + (long)y * surface->pitch, 4, surface->w, fd) != (size_t)surface->w) ok = 0;
+  }
+  if (fclose(fd) != 0) ok = 0;
+  if ((ok == 0) || (rename(tmpname, filename) != 0)) remove(tmpname);  /* don't leave a truncated file behind */
+}
+
+
+/* loads an image from memory as the pixels of its texture: texformat, alpha
+ * included as is. the pixels come from the texture cache if it is enabled and
+ * has them. otherwise the image is decoded, converted unless it already is in
+ * texformat, and stored into the cache for the next time. the surface must be
+ * released with freegzbmp_surface() */
+static SDL_Surface *loadrgba_surface(unsigned char *memgz, long memgzlen) {
+  SDL_Surface *surface, *res;
+  char filename[4096];
+  filename[0] = 0;
+  if (cachedir != NULL) {
+    snprintf(filename, sizeof(filename), "%stex-%08lx-%08lx-%08lx.bin", cachedir, (unsigned long)gzbmp_hash(memgz, memgzlen), (unsigned long)memgzlen, (unsigned long)texformat);
+    res = texcache_load(filename);
+    if (res != NULL) return(res);
+  }
+  surface = loadgzbmp_surface(memgz, memgzlen);
+  if (surface == NULL) return(NULL);
+  if (surface->format->format == texformat) { /* 32 bit bmp pixels, usable as they are */
+      res = surface;
+    } else { /* a plain copy, alpha is not blended */
+      res = SDL_ConvertSurfaceFormat(surface, texformat, 0);
+      if (res != NULL) res->userdata = NULL;
+      freegzbmp_surface(surface);
+  }
+  if ((res != NULL) && (filename[0] != 0)) texcache_save(filename, res);
+  return(res);
+}
+
+
+/* a thread of the pool, decoding queued images until asked to quit */
+static int predecodeworker(void *arg) {
+  struct predecoded *p;
+  SDL_Surface *surface;
+  (void)arg;
+  SDL_LockMutex(predecodelock);
+  for (;;) {
+    while ((predecodenext == predecodedcount) && (predecodequit == 0)) SDL_CondWait(predecodework, predecodelock);
+    if (predecodenext == predecodedcount) break;
+    p = &(predecoded[predecodenext++]);
+    SDL_UnlockMutex(predecodelock);
+    surface = loadrgba_surface(p->memgz, p->memgzlen);
+    SDL_LockMutex(predecodelock);
+    p->surface = surface;
+    p->state = PREDECODE_READY;
+    SDL_CondBroadcast(predecodeready);
+  }
+  SDL_UnlockMutex(predecodelock);
+  return(0);
+}
+
+
+/* stops the pool of threads, and frees the images that nobody took */
+static void predecode_end(void) {
+  int i;
+  if (predecodethreads > 0) {
+    SDL_LockMutex(predecodelock);
+    predecodequit = 1;
+    SDL_CondBroadcast(predecodework);
+    SDL_UnlockMutex(predecodelock);
+    while (predecodethreads > 0) SDL_WaitThread(predecodepool[--predecodethreads], NULL);
+  }
+  for (i = 0; i < predecodedcount; i++) {
+    if (predecoded[i].state == PREDECODE_READY) freegzbmp_surface(predecoded[i].surface);
+  }
+  predecodedcount = 0;
+  predecodenext = 0;
+  predecodetaken = 0;
+  predecodequit = 0;
+  if (predecodeready != NULL) SDL_DestroyCond(predecodeready);
+  if (predecodework != NULL) SDL_DestroyCond(predecodework);
+  if (predecodelock != NULL) SDL_DestroyMutex(predecodelock);
+  predecodeready = NULL;
+  predecodework = NULL;
+  predecodelock = NULL;
+}
+
+
+/* returns the pixels of a gziped bmp image, as loadrgba_surface() does. if the
+ * image has been queued by gra_predecode(), waits for a thread of the pool to
+ * load it, otherwise loads it right away */
+static SDL_Surface *getgzbmp_surface(unsigned char *memgz, long memgzlen) {
+  SDL_Surface *res;
+  int i;
+  if (predecodedcount == 0) return(loadrgba_surface(memgz, memgzlen));
+  SDL_LockMutex(predecodelock);
+  for (i = 0; i < predecodedcount; i++) {
+    if ((predecoded[i].memgz == memgz) && (predecoded[i].state != PREDECODE_TAKEN)) break;
+  }
+  if (i == predecodedcount) {
+    SDL_UnlockMutex(predecodelock);
+    return(loadrgba_surface(memgz, memgzlen));
+  }
+  while (predecoded[i].state == PREDECODE_QUEUED) SDL_CondWait(predecodeready, predecodelock);
+  res = predecoded[i].surface;
+  predecoded[i].state = PREDECODE_TAKEN;
+  predecodetaken++;
+  SDL_UnlockMutex(predecodelock);
+  if (predecodetaken == predecodedcount) predecode_end();
+  return(res);
+}
+
+
+/* finds room for a w x h sprite in the atlas, adding a page if needed. sprites
+ * are laid on horizontal shelves, with 1 pixel of padding between them.
+ * returns the page's texture and fills x/y, or NULL on failure */
+static SDL_Texture *atlas_alloc(int w, int h, int *x, int *y) {
+  struct atlaspage *page;
+  int i;
+  if ((w > ATLAS_SIZE) || (h > ATLAS_SIZE)) return(NULL);
+  for (i = 0; i <= atlaspages; i++) {
+    if (i == ATLAS_MAXPAGES) return(NULL);
+    page = &(atlas[i]);
+    if (i == atlaspages) { /* all pages are full, start a new one */
+      page->texture = SDL_CreateTexture(renderer, texformat, SDL_TEXTUREACCESS_STATIC, ATLAS_SIZE, ATLAS_SIZE);
+      if (page->texture == NULL) return(NULL);
+      SDL_SetTextureBlendMode(page->texture, SDL_BLENDMODE_BLEND);
+      page->shelfx = 0;
+      page->shelfy = 0;
+      page->shelfh = 0;
+      atlaspages += 1;
+    }
+    /* open a new shelf if the current one is too narrow */
+    if (page->shelfx + w > ATLAS_SIZE) {
+      page->shelfy += page->shelfh + 1;
+      page->shelfx = 0;
+      page->shelfh = 0;
+    }
+    if (page->shelfy + h > ATLAS_SIZE) continue;
+    *x = page->shelfx;
+    *y = page->shelfy;
+    page->shelfx += w + 1;
+    if (h > page->shelfh) page->shelfh = h;
+    return(page->texture);
+  }
+  return(NULL);
+}
+
+
+/* uploads the w x h part at srcrect of a surface returned by
+ * loadrgba_surface() as the texture of a sprite. the part is put in the atlas
+ * if atlasflag is set and it fits, otherwise it gets a texture of its own.
+ * returns 0 on success */
+static int fillsprite(struct gra_sprite *res, SDL_Surface *surface, SDL_Rect *srcrect, int w, int h, int atlasflag) {
+  SDL_Rect dstrect;
+  unsigned char *pixels = surface->pixels;
+  if (srcrect != NULL) {
+    if ((srcrect->x < 0) || (srcrect->y < 0) || (srcrect->x + w > surface->w) || (srcrect->y + h > surface->h)) return(-1);
+    pixels += (srcrect->y * surface->pitch) + (srcrect->x * 4);
+  }
+  res->w = w;
+  res->h = h;
+  res->ptr = NULL;
+  if (atlasflag != 0) res->ptr = atlas_alloc(w, h, &(res->x), &(res->y));
+  res->texw = ATLAS_SIZE;
+  res->texh = ATLAS_SIZE;
+  res->texscale = 1;
+  if (res->ptr == NULL) {
+    res->x = 0;
+    res->y = 0;
+    res->texw = w;
+    res->texh = h;
+    res->ptr = SDL_CreateTexture(renderer, texformat, SDL_TEXTUREACCESS_STATIC, w, h);
+    if (res->ptr == NULL) return(-1);
+    SDL_SetTextureBlendMode(res->ptr, SDL_BLENDMODE_BLEND);
+  }
+  dstrect.x = res->x;
+  dstrect.y = res->y;
+  dstrect.w = w;
+  dstrect.h = h;
+  SDL_UpdateTexture(res->ptr, &dstrect, pixels, surface->pitch);
+  return(0);
+}
+
+
+/* copies a w x h part of a surface into a new sprite. sprites too big for the
+ * atlas get a texture of their own */
+static struct gra_sprite *newsprite(SDL_Surface *surface, SDL_Rect *srcrect, int w, int h) {
+  struct gra_sprite *res;
+  res = calloc(1, sizeof(struct gra_sprite));
+  if (res == NULL) return(NULL);
+  if (fillsprite(res, surface, srcrect, w, h, 1) != 0) {
+    free(res);
+    return(NULL);
+  }
+  return(res);
+}
+
+
+/* frees the textures of the sprites loaded on demand that have been drawn the
+ * longest ago, until 'bytes' more fit in the budget. sprites drawn since the
+ * last refresh are kept, even if the budget can't be met then */
+static void lazy_evict(long bytes) {
+  struct gra_sprite *oldest;
+  int i;
+  if (lazybudget <= 0) return;
+  while (lazybytes + bytes > lazybudget) {
+    oldest = NULL;
+    for (i = 0; i < lazycount; i++) {
+      if ((lazy[i]->ptr == NULL) || (lazy[i]->lastuse == refreshes)) continue;
+      if ((oldest == NULL) || (lazy[i]->lastuse < oldest->lastuse)) oldest = lazy[i];
+    }
+    if (oldest == NULL) return;
+    SDL_DestroyTexture(oldest->ptr);
+    if (lasttexture == oldest->ptr) lasttexture = NULL;
+    oldest->ptr = NULL;
+    lazybytes -= (long)oldest->w * oldest->h * 4;
+  }
+}
+
+
+/* gives its texture to a sprite loaded on demand, decoding its image again.
+ * returns 0 on success */
+static int lazy_load(struct gra_sprite *sprite) {
+  SDL_Surface *surface;
+  int res = -1;
+  prof_begin(PROF_LOADSPRITES);
+  surface = getgzbmp_surface(sprite->memgz, sprite->memgzlen);
+  if (surface != NULL) {
+    lazy_evict((long)surface->w * surface->h * 4);
+    res = fillsprite(sprite, surface, NULL, surface->w, surface->h, 0);
+    if (res == 0) lazybytes += (long)sprite->w * sprite->h * 4;
+    freegzbmp_surface(surface);
+  }
+  prof_end(PROF_LOADSPRITES);
+  return(res);
+}
+
+
+/* counts a call to the renderer drawing from a texture */
+static void countdraw(SDL_Texture *texture) {
+  prof_count(PROF_DRAWCALLS, 1);
+  if (texture != lasttexture) prof_count(PROF_TEXSWITCHES, 1);
+  lasttexture = texture;
+}
+
+
+/* draws all queued sprites, with a single call for every run of sprites
+ * sharing the same texture. sprites are never reordered, so they overlap
+ * exactly like they would if drawn one by one */
+static void batch_flush(void) {
+  int i;
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+  static SDL_Vertex vertex[BATCH_MAXQUADS * 4];
+  static int index[BATCH_MAXQUADS * 6];
+  static int indexready = 0;
+  struct batchquad *q;
+  SDL_Vertex *v;
+  int j;
+  if (indexready == 0) { /* every quad is made of two triangles */
+    for (i = 0; i < BATCH_MAXQUADS; i++) {
+      index[i * 6] = i * 4;
+      index[i * 6 + 1] = i * 4 + 1;
+      index[i * 6 + 2] = i * 4 + 2;
+      index[i * 6 + 3] = i * 4 + 2;
+      index[i * 6 + 4] = i * 4 + 1;
+      index[i * 6 + 5] = i * 4 + 3;
+    }
+    for (i = 0; i < BATCH_MAXQUADS * 4; i++) {
+      vertex[i].color.r = 255;
+      vertex[i].color.g = 255;
+      vertex[i].color.b = 255;
+      vertex[i].color.a = 255;
+    }
+    indexready = 1;
+  }
+  for (i = 0; i < batchlen; i = j) {
+    for (j = i; (j < batchlen) && (batch[j].texture == batch[i].texture); j++) {
+      q = &(batch[j]);
+      v = &(vertex[(j - i) * 4]);
+      v[0].position.x = v[2].position.x = q->dst.x;
+      v[1].position.x = v[3].position.x = q->dst.x + q->dst.w;
+      v[0].position.y = v[1].position.y = q->dst.y;
+      v[2].position.y = v[3].position.y = q->dst.y + q->dst.h;
+      v[0].tex_coord.x = v[2].tex_coord.x = (float)q->src.x / q->texw;
+      v[1].tex_coord.x = v[3].tex_coord.x = (float)(q->src.x + q->src.w) / q->texw;
+      v[0].tex_coord.y = v[1].tex_coord.y = (float)q->src.y / q->texh;
+      v[2].tex_coord.y = v[3].tex_coord.y = (float)(q->src.y + q->src.h) / q->texh;
+    }
+    SDL_RenderGeometry(renderer, batch[i].texture, vertex, (j - i) * 4, index, (j - i) * 6);
+    countdraw(batch[i].texture);
+  }
+#else /* older SDL versions have no geometry API */
+  for (i = 0; i < batchlen; i++) {
+    SDL_RenderCopy(renderer, batch[i].texture, &(batch[i].src), &(batch[i].dst));
+    countdraw(batch[i].texture);
+  }
+#endif
+  batchlen = 0;
+}
+
+
+/* marks a region of the screen as damaged, so it gets copied to the window on the next refresh */
+static void markdirty(SDL_Rect *rect) {
+  SDL_Rect r;
+  int i;
+  if ((backbuffer == NULL) || (drawtolayer != 0)) return;
+  r.x = (rect->x < 0) ? 0 : rect->x;
+  r.y = (rect->y < 0) ? 0 : rect->y;
+  r.w = ((rect->x + rect->w > screenw) ? screenw : rect->x + rect->w) - r.x;
+  r.h = ((rect->y + rect->h > screenh) ? screenh : rect->y + rect->h) - r.y;
+  if ((r.w <= 0) || (r.h <= 0)) return;
+  /* grow an overlapping region if there is one */
+  for (i = 0; i < dirtycount; i++) {
+    if ((r.x <= dirty[i].x + dirty[i].w) && (dirty[i].x <= r.x + r.w) && (r.y <= dirty[i].y + dirty[i].h) && (dirty[i].y <= r.y + r.h)) {
+      SDL_UnionRect(&(dirty[i]), &r, &(dirty[i]));
+      return;
+    }
+  }
+  if (dirtycount == DIRTY_MAXRECTS) { /* too many regions, merge them all */
+    for (i = 1; i < dirtycount; i++) SDL_UnionRect(&(dirty[0]), &(dirty[i]), &(dirty[0]));
+    SDL_UnionRect(&(dirty[0]), &r, &(dirty[0]));
+    dirtycount = 1;
+    return;
+  }
+  dirty[dirtycount++] = r;
+}
+
+
+/* marks the whole screen as damaged */
+static void markalldirty(void) {
+  dirty[0].x = 0;
+  dirty[0].y = 0;
+  dirty[0].w = screenw;
+  dirty[0].h = screenh;
+  dirtycount = 1;
+}
+
+
+/* remembers a drawing operation of the current frame. unless the very same
+ * operation came at the same place in the last frame, the regions it covers
+ * in both frames are damaged */
+static void recordop(SDL_Texture *texture, SDL_Rect *src, SDL_Rect *dst) {
+  struct frameop *op, *last;
+  int n, prev = framecur ^ 1;
+  if ((backbuffer == NULL) || (drawtolayer != 0)) return;
+  n = frameopcount[framecur];
+  if (n == FRAME_MAXOPS) { /* too many operations, the next frame can't be compared to this one */
+    framecleared[framecur] = 0;
+    markalldirty();
+    return;
+  }
+  op = &(frameops[framecur][n]);
+  op->texture = texture;
+  op->src = *src;
+  op->dst = *dst;
+  frameopcount[framecur] = n + 1;
+  if ((framecleared[framecur] == 0) || (framecleared[prev] == 0) || (n >= frameopcount[prev])) {
+    markdirty(dst);
+    return;
+  }
+  last = &(frameops[prev][n]);
+  if ((last->texture == texture) && (memcmp(&(last->src), src, sizeof(SDL_Rect)) == 0) && (memcmp(&(last->dst), dst, sizeof(SDL_Rect)) == 0)) return;
+  markdirty(dst);
+  markdirty(&(last->dst));
+}
+
+
+/* watches for events that wipe the content of the window */
+static int windowwatch(void *userdata, SDL_Event *event) {
+  (void)userdata;
+  if (event->type == SDL_WINDOWEVENT) {
+    switch (event->window.event) {
+      case SDL_WINDOWEVENT_EXPOSED:
+      case SDL_WINDOWEVENT_SIZE_CHANGED:
+      case SDL_WINDOWEVENT_RESTORED:
+        windowreset = 1;
+        break;
+    }
+  }
+  return(0);
+}
+
+
+/* draws a part of a sprite's texture, or queues it if a batch is open */
+static void drawquad(struct gra_sprite *sprite, SDL_Rect *src, SDL_Rect *dst) {
+  if (sprite->memgz != NULL) { /* loaded on demand */
+    if ((sprite->ptr == NULL) && (lazy_load(sprite) != 0)) return;
+    sprite->lastuse = refreshes;
+  }
+  recordop(sprite->ptr, src, dst);
+  if (batching == 0) {
+    SDL_RenderCopy(renderer, sprite->ptr, src, dst);
+    countdraw(sprite->ptr);
+    return;
+  }
+  if (batchlen == BATCH_MAXQUADS) batch_flush();
+  batch[batchlen].texture = sprite->ptr;
+  batch[batchlen].texw = sprite->texw;
+  batch[batchlen].texh = sprite->texh;
+  batch[batchlen].src = *src;
+  batch[batchlen].dst = *dst;
+  batchlen += 1;
+}
+
+
 /* init the video subsystem */
 int gra_init(int width, int height, int flags, char *windowtitle, unsigned char *titleicon, long titleicon_len) {
   int sdl_video_flags = SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE;
   SDL_Surface *titleiconsurface;
+  SDL_RendererInfo info;
+  int i;
 
   if (flags & GRA_FULLSCREEN) sdl_video_flags |= SDL_WINDOW_FULLSCREEN_DESKTOP;
-  SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO);
-  window = SDL_CreateWindow(windowtitle, SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, width, height, sdl_video_flags);
-  renderer = SDL_CreateRenderer(window, -1, 0);
+  renderer = NULL;
+  if (flags & GRA_HEADLESS) { /* no display at all: software rendering into a surface */
+      SDL_Init(SDL_INIT_EVENTS | SDL_INIT_TIMER);
+      SDL_InitSubSystem(SDL_INIT_AUDIO);  /* might fail, the game can do without */
+      offscreen = SDL_CreateRGBSurface(0, width, height, 32, 0xFF000000L, 0x00FF0000L, 0x0000FF00L, 0x000000FFL);
+      if (offscreen != NULL) renderer = SDL_CreateSoftwareRenderer(offscreen);
+    } else {
+      SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO);
+      window = SDL_CreateWindow(windowtitle, SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, width, height, sdl_video_flags);
+      if (flags & GRA_VSYNC) renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_PRESENTVSYNC);
+      if (renderer == NULL) renderer = SDL_CreateRenderer(window, -1, 0);
+  }
   if (renderer == NULL) {
-    SDL_DestroyWindow(window);
+    if (window != NULL) SDL_DestroyWindow(window);
+    if (offscreen != NULL) SDL_FreeSurface(offscreen);
     printf("Renderer could not be created! SDL_Error: %s\n", SDL_GetError());
     return(1);
   }
 
   /* set the window's titlebar icon */
-  if ((titleicon != NULL) && (titleicon_len > 0)) {
+  if ((window != NULL) && (titleicon != NULL) && (titleicon_len > 0)) {
     titleiconsurface = loadgzbmp_surface(titleicon, titleicon_len);
-    if (titleicon != NULL) {
+    if (titleiconsurface != NULL) {
       SDL_SetWindowIcon(window, titleiconsurface);
-      SDL_FreeSurface(titleiconsurface);
+      freegzbmp_surface(titleiconsurface);
     }
   }
 
@@ -74,6 +804,36 @@ int gra_init(int width, int height, int flags, char *windowtitle, unsigned char
   /* set the logical screen size */
   SDL_RenderSetLogicalSize(renderer, width, height);
 
+  /* set up the backbuffer, if the window keeps its content between frames
+   * (software renderer) and render targets are available. other renderers
+   * would have to copy the whole backbuffer at every refresh anyway */
+  screenw = width;
+  screenh = height;
+  if (SDL_GetRendererInfo(renderer, &info) == 0) {
+    if (info.flags & SDL_RENDERER_PRESENTVSYNC) vsync = 1;
+    if (info.flags & SDL_RENDERER_SOFTWARE) keepsframe = 1;
+    /* the first texture format the renderer lists is its native one. sprites
+     * need 32 bit pixels with alpha, if it has none RGBA8888 stays */
+    for (i = 0; i < (int)info.num_texture_formats; i++) {
+      if ((SDL_BITSPERPIXEL(info.texture_formats[i]) == 32) && (SDL_ISPIXELFORMAT_ALPHA(info.texture_formats[i]))) {
+        texformat = info.texture_formats[i];
+        break;
+      }
+    }
+  }
+  if ((keepsframe != 0) && (SDL_RenderTargetSupported(renderer) != SDL_FALSE)) {
+    backbuffer = SDL_CreateTexture(renderer, texformat, SDL_TEXTUREACCESS_TARGET, width, height);
+    if ((backbuffer != NULL) && (SDL_SetRenderTarget(renderer, backbuffer) != 0)) {
+      SDL_DestroyTexture(backbuffer);
+      backbuffer = NULL;
+    }
+  }
+  if (backbuffer != NULL) {
+    SDL_AddEventWatch(windowwatch, NULL);
+    SDL_RenderClear(renderer);
+    markalldirty();
+  }
+
   SDL_ShowCursor(SDL_DISABLE);               /* Hide the mouse cursor */
   return(0);
 }
@@ -81,18 +841,53 @@ int gra_init(int width, int height, int flags, char *windowtitle, unsigned char
 
 /* close and clean up the graphic subsystem */
 void gra_close(void) {
-  SDL_DestroyWindow(window);
+  if (backbuffer != NULL) {
+    SDL_DelEventWatch(windowwatch, NULL);
+    SDL_DestroyTexture(backbuffer);
+  }
+  predecode_end();
+  while (lazycount > 0) {
+    lazycount--;
+    if (lazy[lazycount]->ptr != NULL) SDL_DestroyTexture(lazy[lazycount]->ptr);
+    lazy[lazycount]->ptr = NULL;
+  }
+  lazybytes = 0;
+  if (cachedir != NULL) SDL_free(cachedir);
+  cachedir = NULL;
+  while (atlaspages > 0) SDL_DestroyTexture(atlas[--atlaspages].texture);
+  SDL_DestroyRenderer(renderer);
+  if (window != NULL) SDL_DestroyWindow(window);
+  if (offscreen != NULL) SDL_FreeSurface(offscreen);
   SDL_Quit();
 }
 
 
+/* clears the screen. what gets drawn again the same way as in the last frame
+ * does not damage the screen, if that frame started with a clear too */
 void gra_clear(void) {
+  batch_flush();
   SDL_RenderClear(renderer);
+  if (drawtolayer != 0) return;
+  if ((frameopcount[framecur] != 0) || (framecleared[framecur ^ 1] == 0)) markalldirty();
+  /* a clear in the middle of a frame wipes operations it remembers */
+  framecleared[framecur] = (frameopcount[framecur] == 0) ? 1 : 0;
+}
+
+
+void gra_begin_batch(void) {
+  batching = 1;
+}
+
+
+void gra_end_batch(void) {
+  batch_flush();
+  batching = 0;
 }
 
 
 void gra_switchfullscreen(void) {
   static int fullscreenflag = 0;
+  if (window == NULL) return;
   fullscreenflag ^= 1;
   if (fullscreenflag != 0) {
       SDL_SetWindowFullscreen(window, SDL_WINDOW_FULLSCREEN_DESKTOP);
@@ -100,6 +895,7 @@ void gra_switchfullscreen(void) {
       SDL_SetWindowFullscreen(window, 0);
   }
   SDL_Delay(50); /* wait for 50ms - the video thread needs some time to set things up */
+  windowreset = 1;
 }
 
 
@@ -110,16 +906,21 @@ void gra_drawpartsprite(struct gra_sprite *sprite, int srcx, int srcy, int srcwi
   dstrect.y = dsty * SCALE;
   dstrect.w = srcwidth * SCALE;
   dstrect.h = srcheight * SCALE;
-  srcrect.x = srcx;
-  srcrect.y = srcy;
-  srcrect.w = srcwidth;
-  srcrect.h = srcheight;
-  SDL_RenderCopy(renderer, sprite->ptr, &srcrect, &dstrect);
+  srcrect.x = (sprite->x + srcx) * sprite->texscale;
+  srcrect.y = (sprite->y + srcy) * sprite->texscale;
+  srcrect.w = srcwidth * sprite->texscale;
+  srcrect.h = srcheight * sprite->texscale;
+  drawquad(sprite, &srcrect, &dstrect);
 }
 
 
 void gra_drawsprite_alpha(struct gra_sprite *sprite, int x, int y, int alpha) {
+  static SDL_Rect srcrect;
   static SDL_Rect rect;
+  srcrect.x = sprite->x * sprite->texscale;
+  srcrect.y = sprite->y * sprite->texscale;
+  srcrect.w = sprite->w * sprite->texscale;
+  srcrect.h = sprite->h * sprite->texscale;
   rect.x = x * SCALE;
   alpha = alpha; /* TODO */
   rect.y = y * SCALE;
@@ -127,7 +928,7 @@ void gra_drawsprite_alpha(struct gra_sprite *sprite, int x, int y, int alpha) {
   rect.h = sprite->h * SCALE;
   /* if (alpha < 255) SDL_SetAlpha(sprite->ptr, SDL_SRCALPHA, alpha); TODO */
   /* SDL_BlitSurface(sprite->ptr, NULL, screen, &rect); */
-  SDL_RenderCopy(renderer, sprite->ptr, NULL, &rect);
+  drawquad(sprite, &srcrect, &rect);
   /* if (alpha < 255) SDL_SetAlpha(sprite->ptr, SDL_SRCALPHA, 255); TODO */
 }
 
@@ -137,47 +938,226 @@ void gra_drawsprite(struct gra_sprite *sprite, int x, int y) {
 }
 
 
-void gra_refresh(void) {
+/* copies the damaged regions of the backbuffer to the window and shows them.
+ * does nothing if nothing changed since the last refresh. returns non-zero if
+ * the window has been updated */
+int gra_refresh(void) {
+  int i, prev;
+  prof_begin(PROF_REFRESH);
+  batch_flush();
+  refreshes++;
+  if (backbuffer == NULL) {
+    SDL_RenderPresent(renderer);
+    prof_end(PROF_REFRESH);
+    prof_frame();
+    return(1);
+  }
+  /* what the last frame drew and this one did not is gone from the screen.
+   * a refresh with nothing drawn keeps the last frame to compare with */
+  prev = framecur ^ 1;
+  if ((frameopcount[framecur] != 0) || (framecleared[framecur] != 0)) {
+    if ((framecleared[framecur] != 0) && (framecleared[prev] != 0)) {
+      for (i = frameopcount[framecur]; i < frameopcount[prev]; i++) markdirty(&(frameops[prev][i].dst));
+    }
+    framecur = prev;
+    frameopcount[framecur] = 0;
+    framecleared[framecur] = 0;
+  }
+  if ((dirtycount == 0) && (windowreset == 0)) {
+    prof_end(PROF_REFRESH);
+    return(0);
+  }
+  SDL_SetRenderTarget(renderer, NULL);
+  if ((keepsframe != 0) && (windowreset == 0)) {
+      for (i = 0; i < dirtycount; i++) {
+        SDL_RenderCopy(renderer, backbuffer, &(dirty[i]), &(dirty[i]));
+        countdraw(backbuffer);
+      }
+    } else { /* the window has to be redrawn whole */
+      SDL_RenderClear(renderer);
+      SDL_RenderCopy(renderer, backbuffer, NULL, NULL);
+      countdraw(backbuffer);
+  }
   SDL_RenderPresent(renderer);
+  SDL_SetRenderTarget(renderer, backbuffer);
+  dirtycount = 0;
+  windowreset = 0;
+  prof_end(PROF_REFRESH);
+  prof_frame();
+  return(1);
 }
 
 
-/* loads a gziped bmp image from memory and returns a gra_sprite */
-struct gra_sprite *loadgzbmp(unsigned char *memgz, long memgzlen) {
+int gra_hasvsync(void) {
+  return(vsync);
+}
+
+
+/* copies the screen into pixels, as RGBA8888. returns 0 on success */
+int gra_readscreen(void *pixels, int pitch) {
+  batch_flush();
+  if (SDL_RenderReadPixels(renderer, NULL, SDL_PIXELFORMAT_RGBA8888, pixels, pitch) != 0) return(-1);
+  return(0);
+}
+
+
+/* saves the screen to a BMP file. returns 0 on success */
+int gra_savescreen(char *filename) {
   SDL_Surface *surface;
-  struct gra_sprite *res;
-  surface = loadgzbmp_surface(memgz, memgzlen);
-  if (surface == NULL) return(NULL);
-  res = malloc(sizeof(struct gra_sprite));
-  res->ptr = SDL_CreateTextureFromSurface(renderer, surface);
+  int res = -1;
+  surface = SDL_CreateRGBSurface(0, screenw, screenh, 32, 0xFF000000L, 0x00FF0000L, 0x0000FF00L, 0x000000FFL);
+  if (surface == NULL) return(-1);
+  if (gra_readscreen(surface->pixels, surface->pitch) == 0) res = SDL_SaveBMP(surface, filename);
   SDL_FreeSurface(surface);
-  SDL_QueryTexture(res->ptr, NULL, NULL, &(res->w), &(res->h));
+  return(res);
+}
+
+
+/* creates a layer: a sprite that can be drawn into. returns NULL if the renderer can't do that */
+struct gra_sprite *gra_createlayer(int width, int height) {
+  struct gra_sprite *res;
+  if (SDL_RenderTargetSupported(renderer) == SDL_FALSE) return(NULL);
+  res = calloc(1, sizeof(struct gra_sprite));
+  if (res == NULL) return(NULL);
+  /* the layer has the resolution of the screen, so it looks the same as if drawn directly */
+  res->ptr = SDL_CreateTexture(renderer, texformat, SDL_TEXTUREACCESS_TARGET, width * SCALE, height * SCALE);
+  if (res->ptr == NULL) {
+    free(res);
+    return(NULL);
+  }
+  SDL_SetTextureBlendMode(res->ptr, SDL_BLENDMODE_BLEND);
+  res->x = 0;
+  res->y = 0;
+  res->w = width;
+  res->h = height;
+  res->texw = width * SCALE;
+  res->texh = height * SCALE;
+  res->texscale = SCALE;
+  return(res);
+}
+
+
+/* redirects all drawing into a layer, which is cleared first. returns 0 on success */
+int gra_beginlayer(struct gra_sprite *layer) {
+  batch_flush();
+  if (SDL_SetRenderTarget(renderer, layer->ptr) != 0) return(-1);
+  drawtolayer = 1;
+  SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
+  SDL_RenderClear(renderer);
+  /* wherever the layer is drawn, its content changes */
+  framecleared[0] = 0;
+  framecleared[1] = 0;
+  markalldirty();
+  return(0);
+}
+
+
+/* sends drawing back to the screen */
+void gra_endlayer(void) {
+  batch_flush();
+  SDL_SetRenderTarget(renderer, backbuffer);
+  drawtolayer = 0;
+  SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+}
+
+
+void gra_predecode(void *memgz, long memgzlen) {
+  SDL_Thread *thread;
+  int i, threads;
+  if (predecodethreads == 0) { /* start the pool */
+    predecodelock = SDL_CreateMutex();
+    predecodework = SDL_CreateCond();
+    predecodeready = SDL_CreateCond();
+    if ((predecodelock == NULL) || (predecodework == NULL) || (predecodeready == NULL)) {
+      predecode_end();
+      return;
+    }
+    threads = SDL_GetCPUCount();
+    if (threads < 1) threads = 1;
+    if (threads > PREDECODE_MAXTHREADS) threads = PREDECODE_MAXTHREADS;
+    for (i = 0; i < threads; i++) {
+      thread = SDL_CreateThread(predecodeworker, "predecode", NULL);
+      if (thread != NULL) predecodepool[predecodethreads++] = thread;
+    }
+    if (predecodethreads == 0) { /* no threads, images get decoded when loaded */
+      predecode_end();
+      return;
+    }
+  }
+  SDL_LockMutex(predecodelock);
+  if (predecodedcount < PREDECODE_MAX) {
+    predecoded[predecodedcount].memgz = memgz;
+    predecoded[predecodedcount].memgzlen = memgzlen;
+    predecoded[predecodedcount].surface = NULL;
+    predecoded[predecodedcount].state = PREDECODE_QUEUED;
+    predecodedcount++;
+    SDL_CondSignal(predecodework);
+  }
+  SDL_UnlockMutex(predecodelock);
+}
+
+
+int gra_enablecache(char *appname) {
+  if (cachedir != NULL) SDL_free(cachedir);
+  cachedir = SDL_GetPrefPath("Mateusz Viste", appname);
+  if (cachedir == NULL) return(-1);
+  return(0);
+}
+
+
+void gra_setbudget(long bytes) {
+  lazybudget = bytes;
+  lazy_evict(0);
+}
+
+
+/* loads a bmp image, gziped or not, from memory and returns a gra_sprite. the
+ * image is only decoded when the sprite gets drawn, only its size is read
+ * right away */
+struct gra_sprite *loadgzbmp(unsigned char *memgz, long memgzlen) {
+  SDL_Surface *surface;
+  struct gra_sprite *res = NULL;
+  unsigned char header[26];
+  if ((lazycount < LAZY_MAX) && (gzbmp_read(memgz, memgzlen, header, sizeof(header)) == 0) && (header[0] == 'B') && (header[1] == 'M')) {
+    res = calloc(1, sizeof(struct gra_sprite));
+    if (res == NULL) return(NULL);
+    res->w = (Sint32)bmp_read32(header + 18);
+    res->h = (Sint32)bmp_read32(header + 22);
+    if (res->h < 0) res->h = -res->h;
+    res->texscale = 1;
+    res->memgz = memgz;
+    res->memgzlen = memgzlen;
+    lazy[lazycount++] = res;
+    return(res);
+  }
+  prof_begin(PROF_LOADSPRITES);
+  surface = getgzbmp_surface(memgz, memgzlen);
+  if (surface != NULL) {
+    res = newsprite(surface, NULL, surface->w, surface->h);
+    freegzbmp_surface(surface);
+  }
+  prof_end(PROF_LOADSPRITES);
   return(res);
 }
 
 
 void loadSpriteSheet(struct gra_sprite **sprites, int width, int height, int itemcount, void *memptr, int memlen) {
-  SDL_Surface *spritesheet, *item;
+  SDL_Surface *spritesheet;
   SDL_Rect rect;
   int i;
-  spritesheet = loadgzbmp_surface(memptr, memlen);
+  prof_begin(PROF_LOADSPRITES);
+  spritesheet = getgzbmp_surface(memptr, memlen);
   if (spritesheet == NULL) puts("bmp is NULL!!!");
-  item = SDL_CreateRGBSurface(SDL_SWSURFACE, width, height, 32, 0xFF000000L, 0x00FF0000L, 0x0000FF00L, 0x000000FFL);
-  if (item == NULL) puts("item is NULL!!!");
   for (i = 0; i < itemcount; i++) {
     rect.x = i * width;
     rect.y = 0;
     rect.w = width;
     rect.h = height;
-    SDL_FillRect(item, NULL, 0);
-    SDL_BlitSurface(spritesheet, &rect, item, NULL);
-    sprites[i] = malloc(sizeof(struct gra_sprite));
-    sprites[i]->ptr = SDL_CreateTextureFromSurface(renderer, item);
-    if (sprites[i]->ptr == NULL) puts("sprites[i]->ptr is NULL!!!");
-    SDL_QueryTexture(sprites[i]->ptr, NULL, NULL, &(sprites[i]->w), &(sprites[i]->h));
+    sprites[i] = newsprite(spritesheet, &rect, width, height);
+    if (sprites[i] == NULL) puts("sprites[i] is NULL!!!");
   }
-  SDL_FreeSurface(item);
-  SDL_FreeSurface(spritesheet);
+  freegzbmp_surface(spritesheet);
+  prof_end(PROF_LOADSPRITES);
 }
 
 
@@ -192,12 +1172,18 @@ int gra_getspriteheight(struct gra_sprite *sprite) {
 
 
 int gra_drawrect(int x, int y, int width, int height, int r, int g, int b, int a, int fillflag) {
-  SDL_Rect rect;
+  SDL_Rect rect, colors;
   int res;
   rect.x = x;
   rect.y = y;
   rect.w = width;
   rect.h = height;
+  batch_flush();
+  colors.x = (r << 16) | (g << 8) | b;
+  colors.y = a;
+  colors.w = fillflag;
+  colors.h = 0;
+  recordop(NULL, &colors, &rect);
   res = SDL_SetRenderDrawColor(renderer, r, g, b, a);
   if (res != 0) return(-1);
   if (fillflag == 0) {
@@ -7,6 +7,8 @@
 #define drv_gra_h_sentinel
 
 #define GRA_FULLSCREEN 1
+#define GRA_VSYNC 2       /* sync refreshes to the display's vertical retrace, if possible */
+#define GRA_HEADLESS 4    /* no window: draw offscreen, for benchmarks and tests */
 
 struct gra_sprite;
 
@@ -19,6 +21,13 @@ void gra_close(void);
 /* clears the screen (should be used at each screen refresh iteration) */
 void gra_clear(void);
 
+/* starts queuing sprites instead of drawing them one by one. queued sprites
+ * are drawn by gra_end_batch(), or before anything else that draws */
+void gra_begin_batch(void);
+
+/* draws all queued sprites, and goes back to drawing sprites at once */
+void gra_end_batch(void);
+
 /* switch the application fullscreen on/off */
 void gra_switchfullscreen(void);
 
@@ -28,9 +37,49 @@ void gra_drawsprite_alpha(struct gra_sprite *sprite, int x, int y, int alpha);
 
 void gra_drawsprite(struct gra_sprite *sprite, int x, int y);
 
-void gra_refresh(void);
+/* shows what has been drawn. returns non-zero if the screen has been updated */
+int gra_refresh(void);
+
+/* returns non-zero if refreshes wait for the display's vertical retrace */
+int gra_hasvsync(void);
+
+/* copies the screen into pixels, as width x height 32-bit RGBA8888 pixels,
+ * pitch bytes apart from one line to the next. returns 0 on success */
+int gra_readscreen(void *pixels, int pitch);
+
+/* saves the screen to a BMP file. returns 0 on success */
+int gra_savescreen(char *filename);
+
+/* creates a layer: a sprite of width x height that can be drawn into, to
+ * keep parts of the screen that rarely change. returns NULL if the renderer
+ * has no support for this */
+struct gra_sprite *gra_createlayer(int width, int height);
+
+/* sends all drawing to a layer (cleared first), until gra_endlayer() is called. returns 0 on success */
+int gra_beginlayer(struct gra_sprite *layer);
+
+/* sends drawing back to the screen */
+void gra_endlayer(void);
+
+/* starts decoding a gziped bmp image in the background, on a pool of as many
+ * threads as there are cores. a later loadgzbmp() or loadSpriteSheet() of the
+ * image only has to wait for it to be decoded, and makes the sprite out of it */
+void gra_predecode(void *memgz, long memgzlen);
+
+/* keeps the decoded pixels of all images in files under the preferences
+ * directory of appname, so the next runs load them from there instead of
+ * decoding and converting them again. must be called before loading any
+ * image. returns 0 on success */
+int gra_enablecache(char *appname);
+
+/* sets how much memory the textures of the images loaded by loadgzbmp() may
+ * use, 0 for no limit. past that, the textures drawn the longest ago are
+ * freed, and decoded again when drawn next. images drawn since the last
+ * refresh are never freed, so the limit is not a hard one */
+void gra_setbudget(long bytes);
 
-/* loads a gziped bmp image from memory and returns a surface */
+/* loads a gziped bmp image from memory and returns a sprite. the image only
+ * gets decoded when the sprite is drawn for the first time */
 struct gra_sprite *loadgzbmp(unsigned char *memgz, long memgzlen);
 
 void loadSpriteSheet(struct gra_sprite **sprites, int width, int height, int itemcount, void *memptr, int memlen);
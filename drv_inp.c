@@ -36,7 +36,6 @@ static enum atomiks_keys sdlkey2atomiks(int sdlkey) {
       return(atomiks_enter);
     #ifdef __GCW0__
     case SDLK_LSHIFT: /*Y*/
-    case SDLK_TAB: /*L1*/
     #else
     case SDLK_HOME:
     case SDLK_KP_7:
@@ -44,7 +43,6 @@ static enum atomiks_keys sdlkey2atomiks(int sdlkey) {
       return(atomiks_home);
     #ifdef __GCW0__
     case SDLK_SPACE: /*X*/
-    case SDLK_BACKSPACE: /*R1*/
     #else
     case SDLK_END:
     case SDLK_KP_1:
@@ -52,7 +50,31 @@ static enum atomiks_keys sdlkey2atomiks(int sdlkey) {
       return(atomiks_end);
     case SDLK_ESCAPE: /*SELECT*/
       return(atomiks_esc);
+    #ifdef __GCW0__
+    case SDLK_RETURN: /*START*/
+    #else
+    case SDLK_h:
+    case SDLK_F1:
+    #endif
+      return(atomiks_hint);
+    #ifdef __GCW0__
+    case SDLK_TAB: /*L1*/
+    #else
+    case SDLK_BACKSPACE:
+    case SDLK_u:
+    case SDLK_z:
+    #endif
+      return(atomiks_undo);
+    #ifdef __GCW0__
+    case SDLK_BACKSPACE: /*R1*/
+    #else
+    case SDLK_r:
+    case SDLK_y:
+    #endif
+      return(atomiks_redo);
     #ifndef __GCW0__
+    case SDLK_F3:
+      return(atomiks_profile);
     case SDLK_LALT: /* ALT presses shall be ignored */
     case SDLK_RALT:
       return(atomiks_none);
@@ -75,11 +97,13 @@ void inp_flush_events(void) {
 enum atomiks_keys inp_waitkey(int timeout) {
   SDL_Event event;
   int evres;
-  long timeouttime;
+  long timeouttime, timeleft;
   timeouttime = tim_getticks() + timeout;
   for (;;) {
-    if (timeout > 0) {
-      evres = SDL_WaitEventTimeout(&event, 250);
+    if (timeout > 0) { /* sleep until an event comes, or the timeout */
+      timeleft = timeouttime - tim_getticks();
+      if (timeleft <= 0) return(atomiks_none);
+      evres = SDL_WaitEventTimeout(&event, timeleft);
     } else {
       evres = SDL_PollEvent(&event);
     }
@@ -20,6 +20,10 @@ enum atomiks_keys {
   atomiks_gotfocus,
   atomiks_lostfocus,
   atomiks_fullscreen,
+  atomiks_hint,
+  atomiks_undo,
+  atomiks_redo,
+  atomiks_profile,
   atomiks_unknown
 };
 
@@ -3,26 +3,86 @@
  * Copyright (C) Mateusz Viste 2014, 2015
  */
 
+#include <string.h>   /* memset() */
 #include <SDL2/SDL.h>
+#ifndef _WIN32
+#include <errno.h>
+#include <time.h>     /* clock_gettime(), clock_nanosleep() */
+#endif
 
 #include "drv_tim.h" /* include self for control */
 
+/* waits sleep until they are that close to their deadline, and spin the rest. the OS
+ * wakes threads up late by a fraction of a ms, SDL_Delay() by up to a few ms */
+#ifndef _WIN32
+#define SPIN_NS 500000
+#else
+#define SPIN_NS 2000000
+#endif
+
+static struct tim_stats stats;
+
+
+/* returns the current time in nanoseconds, from the high resolution clock */
+unsigned long long tim_getnanoticks(void) {
+  static Uint64 freq = 0;
+  Uint64 counter;
+  if (freq == 0) freq = SDL_GetPerformanceFrequency();
+  counter = SDL_GetPerformanceCounter();
+  return((counter / freq) * 1000000000ull + ((counter % freq) * 1000000000ull) / freq);
+}
+
+
+/* sleeps for about ns nanoseconds, never much more */
+static void sleepfor(unsigned long long ns) {
+#ifndef _WIN32
+  struct timespec deadline;
+  /* the deadline is absolute, so a signal interrupting the sleep doesn't make it any longer */
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  deadline.tv_sec += ns / 1000000000ull;
+  deadline.tv_nsec += ns % 1000000000ull;
+  if (deadline.tv_nsec >= 1000000000L) {
+    deadline.tv_sec += 1;
+    deadline.tv_nsec -= 1000000000L;
+  }
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR);
+#else
+  SDL_Delay(ns / 1000000);
+#endif
+}
+
+
+/* waits until a specific time in nanoseconds, sleeping while far from it and
+ * spinning the last bit. returns how late it woke up, in nanoseconds */
+static unsigned long long waituntil(unsigned long long deadline) {
+  unsigned long long now, late;
+  for (;;) {
+    now = tim_getnanoticks();
+    if (now >= deadline) break;
+    if (deadline - now > SPIN_NS) sleepfor(deadline - now - SPIN_NS);
+  }
+  late = now - deadline;
+  stats.waits += 1;
+  stats.lastdrift = late;
+  stats.totaldrift += late;
+  if (late > stats.maxdrift) stats.maxdrift = late;
+  return(late);
+}
+
 
 /* waits until a specific time. */
 void tim_wait_until_tick(unsigned long tick, long *overtime) {
+  long ticksleft;
   if (overtime != NULL) tick -= *overtime;
-  while (SDL_GetTicks() < tick) {
-    SDL_Delay(1);
-  }
+  ticksleft = (long)(tick - SDL_GetTicks());
+  if (ticksleft > 0) waituntil(tim_getnanoticks() + ticksleft * 1000000ull);
   if (overtime != NULL) *overtime = SDL_GetTicks() - tick;
 }
 
 
 /* waits for a number of miliseconds */
 void tim_delay(long ms) {
-  unsigned long waituntil;
-  waituntil = SDL_GetTicks() + ms;
-  tim_wait_until_tick(waituntil, NULL);
+  if (ms > 0) waituntil(tim_getnanoticks() + ms * 1000000ull);
 }
 
 
@@ -30,3 +90,26 @@ void tim_delay(long ms) {
 long tim_getticks(void) {
   return(SDL_GetTicks());
 }
+
+
+/* returns the current time in microseconds, from a high resolution clock */
+unsigned long long tim_getmicroticks(void) {
+  return(tim_getnanoticks() / 1000);
+}
+
+
+/* waits until a specific time in microseconds, as precisely as possible */
+void tim_wait_until_microtick(unsigned long long microtick) {
+  waituntil(microtick * 1000);
+}
+
+
+/* fills stats with the statistics of all waits since the last reset */
+void tim_getstats(struct tim_stats *s) {
+  *s = stats;
+}
+
+
+void tim_resetstats(void) {
+  memset(&stats, 0, sizeof(stats));
+}
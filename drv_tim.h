@@ -6,6 +6,14 @@
 #ifndef drv_tim_h_sentinel
 #define drv_tim_h_sentinel
 
+/* how late waits woke up, past their deadline */
+struct tim_stats {
+  unsigned long waits;              /* number of waits */
+  unsigned long long lastdrift;     /* nanoseconds late on the last wait */
+  unsigned long long maxdrift;      /* nanoseconds late on the worst wait */
+  unsigned long long totaldrift;    /* sum of all drifts, in nanoseconds */
+};
+
 /* waits until a specific time. */
 void tim_wait_until_tick(unsigned long tick, long *overtime);
 
@@ -15,4 +23,19 @@ void tim_delay(long ms);
 /* returns the current ticks value */
 long tim_getticks(void);
 
+/* returns the current time in microseconds, from a high resolution clock */
+unsigned long long tim_getmicroticks(void);
+
+/* waits until a specific time in microseconds, as precisely as possible */
+void tim_wait_until_microtick(unsigned long long microtick);
+
+/* returns the current time in nanoseconds, from a high resolution clock */
+unsigned long long tim_getnanoticks(void);
+
+/* fills stats with the statistics of all waits since the last reset */
+void tim_getstats(struct tim_stats *stats);
+
+/* resets the wait statistics */
+void tim_resetstats(void);
+
 #endif
@@ -5,6 +5,13 @@
 
 #ifndef gz_h_sentinel
 #define gz_h_sentinel
+  /* decompresses a gz file in memory. returns a pointer to a newly allocated memory chunk (holding uncompressed data), or NULL on error. */
   unsigned char *ungz(unsigned char *memgz, long memgzlen, long *resultlen);
+  /* returns the uncompressed length of a gz file, as stored in its trailer, or -1 on error */
+  long ungz_len(unsigned char *memgz, long memgzlen);
+  /* decompresses a gz file in memory into dest, using no other memory. if
+   * destlen is less than ungz_len(), only the first destlen bytes of the file
+   * are decompressed. returns 0 on success */
+  int ungz_into(unsigned char *memgz, long memgzlen, unsigned char *dest, long destlen);
   int isGz(unsigned char *memgz, long memgzlen);
 #endif
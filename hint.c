@@ -0,0 +1,192 @@
+/*
+ * This file is part of the Atomiks project
+ * Copyright (C) Mateusz Viste 2013, 2014, 2015
+ *
+ * Computes hints (the next move of a shortest solution) on a background
+ * thread, and remembers them for every game state visited.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>    /* malloc(), calloc(), free() */
+#include <string.h>    /* memcpy() */
+#include <time.h>
+#include <SDL2/SDL.h>
+#include "atomcore.h"
+#include "atomsolve.h"
+#include "atomtt.h"
+#include "hint.h"      /* include self for control */
+
+/* the max number of states a single solve may expand. States whose shortest
+ * solution is out of reach show no hint, instead of eating all the memory of
+ * the device */
+#ifdef __GCW0__
+  #define HINT_MAXNODES 100000
+#else
+  #define HINT_MAXNODES 400000
+#endif
+
+#define HINT_CACHESIZE 65536
+
+/* layout of hints in the cache */
+#define HINT_KNOWN (1ull << 63)         /* always set, so entries are never 0 */
+#define HINT_NOMOVE (1ull << 62)        /* the solver gave up on this state */
+
+struct hint {
+  SDL_Thread *thread;
+  SDL_mutex *lock;              /* protects everything below */
+  SDL_cond *wakeup;
+  struct atomix_tt *cache;      /* hints of all states seen so far, by hash */
+  int level;                    /* level the cache is about */
+  struct atomixgame *request;   /* state to solve, if requested is set */
+  int requested;
+  unsigned long long busyhash;  /* hash of the state being solved, if busy is set */
+  int busy;
+  int quit;
+  volatile int cancel;          /* tells the solve running to give up */
+};
+
+
+/* solves a copy of the game, and caches the first move of every state met
+ * along the solution. Only shortest solutions are cached, a state the solver
+ * gave up on getting no hint at all */
+static void solvestate(struct hint *h, struct atomixgame *game) {
+  struct atomix_solution solution;
+  struct atomix_move *m;
+  int i, res;
+  res = atomix_solve_parallel(game, 1, HINT_MAXNODES, 0, &(h->cancel), &solution);
+  SDL_LockMutex(h->lock);
+  if ((game->level == h->level) && (h->cancel == 0)) {
+    if ((res != ATOMIX_SOLVE_FOUND) || (solution.optimal == 0)) {
+        atomix_tt_store(h->cache, game->hash, HINT_KNOWN | HINT_NOMOVE);
+      } else {
+        for (i = 0; i < solution.movecount; i++) {
+          m = &(solution.moves[i]);
+          atomix_tt_store(h->cache, game->hash, HINT_KNOWN | ((unsigned long long)(solution.movecount - i) << 32) | (m->x << 24) | (m->y << 16) | (m->direction << 8) | m->distance);
+          /* play the move to get the next state */
+          atomix_playmove(game, m->x, m->y, m->direction, 0);
+        }
+    }
+  }
+  h->busy = 0;
+  SDL_UnlockMutex(h->lock);
+  atomix_freesolution(&solution);
+}
+
+
+/* the hint thread, solving whatever state is requested until asked to quit */
+static int hintthread(void *arg) {
+  struct hint *h = arg;
+  struct atomixgame *game;
+  game = atomix_initgame();
+  if (game == NULL) return(-1);
+  SDL_LockMutex(h->lock);
+  for (;;) {
+    while ((h->requested == 0) && (h->quit == 0)) SDL_CondWait(h->wakeup, h->lock);
+    if (h->quit != 0) break;
+    memcpy(game, h->request, sizeof(struct atomixgame));
+    h->requested = 0;
+    h->busy = 1;
+    h->busyhash = game->hash;
+    h->cancel = 0;
+    SDL_UnlockMutex(h->lock);
+    solvestate(h, game);
+    SDL_LockMutex(h->lock);
+  }
+  SDL_UnlockMutex(h->lock);
+  free(game);
+  return(0);
+}
+
+
+struct hint *hint_init(void) {
+  struct hint *h;
+  h = calloc(1, sizeof(struct hint));
+  if (h == NULL) return(NULL);
+  h->request = atomix_initgame();
+  h->cache = atomix_tt_new(HINT_CACHESIZE);
+  h->lock = SDL_CreateMutex();
+  h->wakeup = SDL_CreateCond();
+  if ((h->request == NULL) || (h->cache == NULL) || (h->lock == NULL) || (h->wakeup == NULL)) {
+    hint_close(h);
+    return(NULL);
+  }
+  h->thread = SDL_CreateThread(hintthread, "hint", h);
+  if (h->thread == NULL) {
+    hint_close(h);
+    return(NULL);
+  }
+  return(h);
+}
+
+
+void hint_close(struct hint *h) {
+  if (h == NULL) return;
+  if (h->thread != NULL) { /* cuts any solve short, so the thread quits at once */
+    SDL_LockMutex(h->lock);
+    h->quit = 1;
+    h->cancel = 1;
+    SDL_CondSignal(h->wakeup);
+    SDL_UnlockMutex(h->lock);
+    SDL_WaitThread(h->thread, NULL);
+  }
+  if (h->wakeup != NULL) SDL_DestroyCond(h->wakeup);
+  if (h->lock != NULL) SDL_DestroyMutex(h->lock);
+  if (h->cache != NULL) atomix_tt_free(h->cache);
+  free(h->request);
+  free(h);
+}
+
+
+void hint_request(struct hint *h, struct atomixgame *game) {
+  unsigned long long data;
+  SDL_LockMutex(h->lock);
+  if (game->level != h->level) { /* hashes of other levels mean nothing */
+    atomix_tt_clear(h->cache);
+    h->level = game->level;
+    if (h->busy != 0) h->cancel = 1; /* the solve running is about the old level */
+  }
+  if ((atomix_tt_probe(h->cache, game->hash, &data) == 0) && ((h->busy == 0) || (h->busyhash != game->hash))) {
+    /* replaces any older request that didn't start yet */
+    memcpy(h->request, game, sizeof(struct atomixgame));
+    h->requested = 1;
+    SDL_CondSignal(h->wakeup);
+  }
+  SDL_UnlockMutex(h->lock);
+}
+
+
+int hint_get(struct hint *h, struct atomixgame *game, struct atomix_move *move, int *remaining) {
+  unsigned long long data;
+  int res = HINT_NONE;
+  SDL_LockMutex(h->lock);
+  if (game->level == h->level) {
+    if (atomix_tt_probe(h->cache, game->hash, &data) != 0) {
+        if (data & HINT_NOMOVE) {
+            res = HINT_UNAVAILABLE;
+          } else {
+            move->x = (data >> 24) & 0xFF;
+            move->y = (data >> 16) & 0xFF;
+            move->direction = (data >> 8) & 0xFF;
+            move->distance = data & 0xFF;
+            if (remaining != NULL) *remaining = (data >> 32) & 0xFFFF;
+            res = HINT_READY;
+        }
+      } else if (((h->busy != 0) && (h->busyhash == game->hash)) || ((h->requested != 0) && (h->request->hash == game->hash))) {
+        res = HINT_PENDING;
+    }
+  }
+  SDL_UnlockMutex(h->lock);
+  return(res);
+}
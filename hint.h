@@ -0,0 +1,37 @@
+/*
+ * This file is part of the Atomiks project
+ * Copyright (C) Mateusz Viste 2013, 2014, 2015
+ *
+ * Computes hints (the next move of an optimal solution) on a background
+ * thread, and remembers them for every game state visited.
+ */
+
+#ifndef hint_h_sentinel
+#define hint_h_sentinel
+
+  #include "atomcore.h"
+  #include "atomsolve.h"
+
+  #define HINT_NONE 0         /* no hint has been asked for this state */
+  #define HINT_PENDING 1      /* the hint is being computed */
+  #define HINT_READY 2        /* the hint is known */
+  #define HINT_UNAVAILABLE 3  /* the solver gave up on this state */
+
+  struct hint;
+
+  /* starts the hint thread. returns NULL on failure */
+  struct hint *hint_init(void);
+
+  /* stops the hint thread and frees everything */
+  void hint_close(struct hint *h);
+
+  /* asks for a hint about the current state of the game. returns at once, the
+   * hint being computed in the background unless it is known already */
+  void hint_request(struct hint *h, struct atomixgame *game);
+
+  /* returns the HINT_xxx status of the current state of the game. if the hint
+   * is ready, move is filled with the next move, and remaining with the number
+   * of moves left to solve the level */
+  int hint_get(struct hint *h, struct atomixgame *game, struct atomix_move *move, int *remaining);
+
+#endif
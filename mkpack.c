@@ -0,0 +1,118 @@
+/*
+ * mkpack builds an Atomiks asset pack out of data files.
+ * Copyright (C) Mateusz Viste 2015
+ *
+ * Assets are named after their file, the same way file2c names its
+ * variables (img/title.bmp.gz becomes img_title_bmp_gz), so the game finds
+ * them in the pack under the name of their compiled-in copy.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h> /* needed for strdup() */
+
+#include "pack.h"
+
+/* creates a suitable variable name from a filename (replacing all invalid chars by underscores) */
+char *filename2varname(char *filename) {
+  char *result;
+  int x;
+  result = strdup(filename);
+  for (x = 0; result[x] != 0; x++) {
+    if ((result[x] >= '0') && (result[x] <= '9') && (x > 0)) continue;
+    if ((result[x] >= 'a') && (result[x] <= 'z')) continue;
+    if ((result[x] >= 'A') && (result[x] <= 'Z')) continue;
+    result[x] = '_';
+  }
+  return(result);
+}
+
+static void write32(FILE *fd, unsigned long v) {
+  putc(v & 0xff, fd);
+  putc((v >> 8) & 0xff, fd);
+  putc((v >> 16) & 0xff, fd);
+  putc((v >> 24) & 0xff, fd);
+}
+
+/* returns the length of a file, or -1 if it can't be read */
+static long filelen(char *filename) {
+  FILE *fd;
+  long res;
+  fd = fopen(filename, "rb");
+  if (fd == NULL) return(-1);
+  fseek(fd, 0, SEEK_END);
+  res = ftell(fd);
+  fclose(fd);
+  return(res);
+}
+
+/* tells whether a file starts with the gzip signature */
+static int isgzipfile(char *filename) {
+  FILE *fd;
+  int res;
+  fd = fopen(filename, "rb");
+  if (fd == NULL) return(0);
+  res = ((getc(fd) == 0x1F) && (getc(fd) == 0x8B));
+  fclose(fd);
+  return(res);
+}
+
+int main(int argc, char **argv) {
+  FILE *fd, *fdin;
+  int x, bytebuff, count;
+  long offset, len;
+  char *varname;
+  char name[PACK_NAMELEN];
+  if ((argc < 3) || (argv[1][0] == '-')) {
+    puts("mkpack builds an Atomiks asset pack out of data files. Copyright (C) Mateusz Viste 2015");
+    puts("Usage: mkpack file.pak file1.dat [file2.dat ...]");
+    return(1);
+  }
+  count = argc - 2;
+  fd = fopen(argv[1], "wb");
+  if (fd == NULL) {
+    printf("Error: failed to create '%s'.\n", argv[1]);
+    return(3);
+  }
+  /* write the header */
+  fwrite(PACK_MAGIC, 1, 8, fd);
+  write32(fd, PACK_VERSION);
+  write32(fd, count);
+  /* write the toc */
+  offset = PACK_HEADERLEN + (count * PACK_TOCENTRYLEN);
+  for (x = 2; x < argc; x++) {
+    varname = filename2varname(argv[x]);
+    len = filelen(argv[x]);
+    if ((varname == NULL) || (strlen(varname) >= PACK_NAMELEN) || (len < 0)) {
+      printf("Error: failed to read '%s', or its name is too long.\n", argv[x]);
+      fclose(fd);
+      remove(argv[1]);
+      return(2);
+    }
+    memset(name, 0, sizeof(name));
+    strcpy(name, varname);
+    free(varname);
+    offset = (offset + PACK_ALIGN - 1) & ~(long)(PACK_ALIGN - 1);
+    fwrite(name, 1, PACK_NAMELEN, fd);
+    write32(fd, offset);
+    write32(fd, len);
+    write32(fd, isgzipfile(argv[x]) ? PACK_GZIP : 0);
+    write32(fd, 0);
+    offset += len;
+  }
+  /* write the data of every file, aligned */
+  for (x = 2; x < argc; x++) {
+    while (ftell(fd) % PACK_ALIGN != 0) putc(0, fd);
+    fdin = fopen(argv[x], "rb");
+    if (fdin == NULL) {
+      printf("Error: failed to open '%s'.\n", argv[x]);
+      fclose(fd);
+      remove(argv[1]);
+      return(3);
+    }
+    while ((bytebuff = getc(fdin)) >= 0) putc(bytebuff, fd);
+    fclose(fdin);
+  }
+  fclose(fd);
+  return(0);
+}
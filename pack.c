@@ -0,0 +1,165 @@
+/*
+ * This file is part of the Atomiks project
+ * Copyright (C) Mateusz Viste 2013, 2014, 2015
+ *
+ * Asset packs: a single file holding the images and sounds of the game,
+ * mapped into memory at startup. Assets the pack does not have are taken
+ * from the copies compiled into the program.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>     /* snprintf() */
+#include <string.h>    /* memcmp(), strncmp() */
+#include <SDL2/SDL.h>  /* SDL_GetBasePath(), SDL_free() */
+#ifdef _WIN32
+#include <windows.h>   /* CreateFileMapping(), MapViewOfFile() */
+#else
+#include <fcntl.h>     /* open() */
+#include <sys/mman.h>  /* mmap(), munmap() */
+#include <sys/stat.h>  /* fstat() */
+#include <unistd.h>    /* close() */
+#endif
+
+#include "pack.h"      /* include self for control */
+
+static unsigned char *pack = NULL;  /* the mapped pack */
+static long packlen = 0;
+static unsigned long entrycount = 0;
+
+
+static unsigned long read32(unsigned char *p) {
+  return(p[0] | p[1] << 8 | p[2] << 16 | (unsigned long)p[3] << 24);
+}
+
+
+/* maps a whole file into memory, read-only. returns NULL on failure */
+static unsigned char *mapfile(char *filename, long *len) {
+  unsigned char *res;
+#ifdef _WIN32
+  HANDLE fh, maph;
+  DWORD size;
+  fh = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (fh == INVALID_HANDLE_VALUE) return(NULL);
+  size = GetFileSize(fh, NULL);
+  if ((size == INVALID_FILE_SIZE) || (size == 0)) {
+    CloseHandle(fh);
+    return(NULL);
+  }
+  maph = CreateFileMappingA(fh, NULL, PAGE_READONLY, 0, 0, NULL);
+  CloseHandle(fh);
+  if (maph == NULL) return(NULL);
+  res = MapViewOfFile(maph, FILE_MAP_READ, 0, 0, 0);
+  CloseHandle(maph);  /* the view keeps the mapping alive */
+  *len = size;
+#else
+  struct stat st;
+  int fd;
+  fd = open(filename, O_RDONLY);
+  if (fd < 0) return(NULL);
+  if ((fstat(fd, &st) != 0) || (st.st_size == 0)) {
+    close(fd);
+    return(NULL);
+  }
+  res = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);  /* the mapping stays valid */
+  if (res == MAP_FAILED) return(NULL);
+  *len = st.st_size;
+#endif
+  return(res);
+}
+
+
+static void unmapfile(unsigned char *ptr, long len) {
+#ifdef _WIN32
+  len = len;
+  UnmapViewOfFile(ptr);
+#else
+  munmap(ptr, len);
+#endif
+}
+
+
+/* returns the toc entry of an asset, or NULL if the pack does not have it */
+static unsigned char *findentry(char *name) {
+  unsigned char *entry;
+  unsigned long i;
+  if (pack == NULL) return(NULL);
+  for (i = 0; i < entrycount; i++) {
+    entry = pack + PACK_HEADERLEN + (i * PACK_TOCENTRYLEN);
+    if (strncmp((char *)entry, name, PACK_NAMELEN) == 0) return(entry);
+  }
+  return(NULL);
+}
+
+
+int pack_open(char *filename) {
+  char filepath[4096];
+  char *basepath;
+  unsigned char *entry;
+  unsigned long i;
+  if (pack != NULL) pack_close();
+  if (filename == NULL) {
+    basepath = SDL_GetBasePath();
+    if (basepath == NULL) return(-1);
+    snprintf(filepath, sizeof(filepath), "%satomiks.pak", basepath);
+    SDL_free(basepath);
+    filename = filepath;
+  }
+  pack = mapfile(filename, &packlen);
+  if (pack == NULL) return(-1);
+  /* check the header and the toc. only the toc is read, the data of an
+   * asset is only paged in when it gets used */
+  if ((packlen < PACK_HEADERLEN) || (memcmp(pack, PACK_MAGIC, 8) != 0) || (read32(pack + 8) != PACK_VERSION)) {
+    pack_close();
+    return(-1);
+  }
+  entrycount = read32(pack + 12);
+  if (entrycount > (unsigned long)(packlen - PACK_HEADERLEN) / PACK_TOCENTRYLEN) {
+    pack_close();
+    return(-1);
+  }
+  for (i = 0; i < entrycount; i++) {
+    entry = pack + PACK_HEADERLEN + (i * PACK_TOCENTRYLEN);
+    if ((entry[PACK_NAMELEN - 1] != 0) || (read32(entry + 32) > (unsigned long)packlen) || (read32(entry + 36) > (unsigned long)packlen - read32(entry + 32))) {
+      pack_close();
+      return(-1);
+    }
+  }
+  return(0);
+}
+
+
+unsigned char *pack_get(char *name, unsigned char *fallback) {
+  unsigned char *entry;
+  entry = findentry(name);
+  if (entry == NULL) return(fallback);
+  return(pack + read32(entry + 32));
+}
+
+
+long pack_getlen(char *name, long fallbacklen) {
+  unsigned char *entry;
+  entry = findentry(name);
+  if (entry == NULL) return(fallbacklen);
+  return(read32(entry + 36));
+}
+
+
+void pack_close(void) {
+  if (pack != NULL) unmapfile(pack, packlen);
+  pack = NULL;
+  packlen = 0;
+  entrycount = 0;
+}
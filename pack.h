@@ -0,0 +1,58 @@
+/*
+ * This file is part of the Atomiks project
+ * Copyright (C) Mateusz Viste 2013, 2014, 2015
+ *
+ * Asset packs: a single file holding the images and sounds of the game,
+ * mapped into memory at startup. Assets the pack does not have are taken
+ * from the copies compiled into the program.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef pack_h_sentinel
+#define pack_h_sentinel
+
+  /* layout of a pack, all numbers being 32 bit little-endian:
+   *   header  "ATMKPACK", version (1), number of entries
+   *   toc     for every entry: name (32 bytes, zero-padded), offset of the
+   *           data from the start of the file, length, flags, reserved (0)
+   *   data    every entry starts on a PACK_ALIGN boundary */
+  #define PACK_MAGIC "ATMKPACK"
+  #define PACK_VERSION 1
+  #define PACK_HEADERLEN 16
+  #define PACK_TOCENTRYLEN 48
+  #define PACK_NAMELEN 32
+  #define PACK_ALIGN 16
+
+  /* entry flags. the loaders tell gziped and raw data apart by themselves,
+   * the flag is there for the tools */
+  #define PACK_GZIP 1  /* the data is a gzip stream, otherwise it is raw */
+
+  /* maps an asset pack into memory. if filename is NULL, looks for
+   * atomiks.pak next to the program. returns 0 on success */
+  int pack_open(char *filename);
+
+  /* returns the data of an asset, named after the variable holding the copy
+   * compiled into the program (eg. "img_title_bmp_gz"). returns that copy
+   * (fallback) if no pack is open, or if the pack does not have the asset */
+  unsigned char *pack_get(char *name, unsigned char *fallback);
+
+  /* returns the length of an asset, or fallbacklen if pack_get() would return
+   * the copy compiled into the program */
+  long pack_getlen(char *name, long fallbacklen);
+
+  /* unmaps the pack. the data pack_get() returned must not be used anymore */
+  void pack_close(void);
+
+#endif
@@ -0,0 +1,183 @@
+/*
+ * This file is part of the Atomiks project
+ * Copyright (C) Mateusz Viste 2013, 2014, 2015
+ *
+ * Optional profiling: times spent in the hot paths of the game, per frame
+ * counters, and a dump of it all as CSV or as a Chrome trace.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>    /* malloc(), qsort(), free() */
+#include <string.h>    /* memset(), strlen(), strcmp() */
+#include <SDL2/SDL.h>  /* SDL_ThreadID() */
+#include "drv_tim.h"
+#include "prof.h"      /* include self for control */
+
+#define PROF_MAXEVENTS 65536  /* zones recorded for the dump, the oldest are overwritten */
+#define PROF_HISTORY 256      /* frames the percentiles are computed on */
+
+struct profevent {
+  unsigned long long start;     /* nanoseconds */
+  unsigned long long duration;
+  unsigned long counter[PROF_COUNTERS];  /* only for frames */
+  int zone;
+};
+
+static char *zonename[PROF_ZONES] = {"frame", "refresh", "drawscreen", "loadsprites", "ungz", "input"};
+
+static int enabled = 0;
+static SDL_threadID profthread;        /* the only thread that gets profiled */
+static struct profevent *events = NULL;
+static unsigned long eventcount = 0;   /* total events recorded, events[eventcount % PROF_MAXEVENTS] is the next one */
+static unsigned long long zonestart[PROF_ZONES];
+static unsigned long counter[PROF_COUNTERS];
+static unsigned long lastcounter[PROF_COUNTERS];
+static unsigned long frametime[PROF_HISTORY];          /* microseconds */
+static unsigned long long frameend[PROF_HISTORY];      /* nanoseconds */
+static unsigned long frames = 0;
+static unsigned long long starttime;
+
+
+static struct profevent *newevent(int zone, unsigned long long start, unsigned long long end) {
+  struct profevent *e = &(events[eventcount % PROF_MAXEVENTS]);
+  eventcount++;
+  e->zone = zone;
+  e->start = start;
+  e->duration = end - start;
+  return(e);
+}
+
+
+int prof_init(void) {
+  events = malloc(PROF_MAXEVENTS * sizeof(struct profevent));
+  if (events == NULL) return(-1);
+  eventcount = 0;
+  frames = 0;
+  memset(counter, 0, sizeof(counter));
+  memset(lastcounter, 0, sizeof(lastcounter));
+  starttime = tim_getnanoticks();
+  zonestart[PROF_FRAME] = starttime;
+  profthread = SDL_ThreadID();
+  enabled = 1;
+  return(0);
+}
+
+
+int prof_enabled(void) {
+  return(enabled);
+}
+
+
+void prof_begin(int zone) {
+  if ((enabled == 0) || (SDL_ThreadID() != profthread)) return;
+  zonestart[zone] = tim_getnanoticks();
+}
+
+
+void prof_end(int zone) {
+  if ((enabled == 0) || (SDL_ThreadID() != profthread)) return;
+  newevent(zone, zonestart[zone], tim_getnanoticks());
+}
+
+
+void prof_count(int c, int n) {
+  if ((enabled == 0) || (SDL_ThreadID() != profthread)) return;
+  counter[c] += n;
+}
+
+
+void prof_frame(void) {
+  struct profevent *e;
+  unsigned long long now;
+  if (enabled == 0) return;
+  now = tim_getnanoticks();
+  e = newevent(PROF_FRAME, zonestart[PROF_FRAME], now);
+  memcpy(e->counter, counter, sizeof(counter));
+  memcpy(lastcounter, counter, sizeof(counter));
+  memset(counter, 0, sizeof(counter));
+  frametime[frames % PROF_HISTORY] = e->duration / 1000;
+  frameend[frames % PROF_HISTORY] = now;
+  frames++;
+  zonestart[PROF_FRAME] = now;
+}
+
+
+static int cmpulong(const void *a, const void *b) {
+  if (*(unsigned long *)a < *(unsigned long *)b) return(-1);
+  if (*(unsigned long *)a > *(unsigned long *)b) return(1);
+  return(0);
+}
+
+
+void prof_getstats(struct prof_stats *stats) {
+  static unsigned long sorted[PROF_HISTORY];
+  unsigned long long now;
+  int i, count;
+  memset(stats, 0, sizeof(struct prof_stats));
+  if (enabled == 0) return;
+  stats->frames = frames;
+  memcpy(stats->counter, lastcounter, sizeof(lastcounter));
+  count = (frames < PROF_HISTORY) ? frames : PROF_HISTORY;
+  if (count == 0) return;
+  now = tim_getnanoticks();
+  for (i = 0; i < count; i++) {
+    sorted[i] = frametime[i];
+    if (now - frameend[i] <= 1000000000ull) stats->fps++;
+  }
+  qsort(sorted, count, sizeof(unsigned long), cmpulong);
+  stats->p50 = sorted[count / 2];
+  stats->p99 = sorted[(count * 99) / 100];
+}
+
+
+int prof_dump(char *filename) {
+  FILE *fd;
+  struct profevent *e;
+  unsigned long i, first;
+  int json = 0;
+  if (events == NULL) return(-1);
+  if ((strlen(filename) > 5) && (strcmp(filename + strlen(filename) - 5, ".json") == 0)) json = 1;
+  fd = fopen(filename, "wb");
+  if (fd == NULL) return(-1);
+  first = (eventcount > PROF_MAXEVENTS) ? eventcount - PROF_MAXEVENTS : 0;
+  if (json != 0) { /* frames overlap other zones, so they go on a track of their own */
+      fprintf(fd, "{\"traceEvents\": [\n");
+    } else {
+      fprintf(fd, "zone,start_us,duration_us,drawcalls,texswitches\n");
+  }
+  for (i = first; i < eventcount; i++) {
+    e = &(events[i % PROF_MAXEVENTS]);
+    if (json != 0) {
+        fprintf(fd, "  {\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f", zonename[e->zone], (e->zone == PROF_FRAME) ? 0 : 1, (e->start - starttime) / 1000.0, e->duration / 1000.0);
+        if (e->zone == PROF_FRAME) fprintf(fd, ", \"args\": {\"drawcalls\": %lu, \"texswitches\": %lu}", e->counter[PROF_DRAWCALLS], e->counter[PROF_TEXSWITCHES]);
+        fprintf(fd, "}%s\n", (i + 1 < eventcount) ? "," : "");
+      } else if (e->zone == PROF_FRAME) {
+        fprintf(fd, "%s,%.3f,%.3f,%lu,%lu\n", zonename[e->zone], (e->start - starttime) / 1000.0, e->duration / 1000.0, e->counter[PROF_DRAWCALLS], e->counter[PROF_TEXSWITCHES]);
+      } else {
+        fprintf(fd, "%s,%.3f,%.3f,,\n", zonename[e->zone], (e->start - starttime) / 1000.0, e->duration / 1000.0);
+    }
+  }
+  if (json != 0) fprintf(fd, "], \"displayTimeUnit\": \"ms\"}\n");
+  if (fclose(fd) != 0) return(-1);
+  return(0);
+}
+
+
+void prof_close(void) {
+  enabled = 0;
+  free(events);
+  events = NULL;
+}
@@ -0,0 +1,63 @@
+/*
+ * This file is part of the Atomiks project
+ * Copyright (C) Mateusz Viste 2013, 2014, 2015
+ *
+ * Optional profiling: times spent in the hot paths of the game, per frame
+ * counters, and a dump of it all as CSV or as a Chrome trace.
+ */
+
+#ifndef prof_h_sentinel
+#define prof_h_sentinel
+
+  /* zones that get timed */
+  #define PROF_FRAME 0        /* from one screen update to the next */
+  #define PROF_REFRESH 1      /* gra_refresh() */
+  #define PROF_DRAWSCREEN 2   /* draw_game_screen() */
+  #define PROF_LOADSPRITES 3  /* loading sprites from compressed images */
+  #define PROF_UNGZ 4         /* ungz() */
+  #define PROF_INPUT 5        /* polling the keyboard */
+  #define PROF_ZONES 6
+
+  /* counters, reset at every frame */
+  #define PROF_DRAWCALLS 0    /* calls to the renderer */
+  #define PROF_TEXSWITCHES 1  /* changes of the texture being drawn from */
+  #define PROF_COUNTERS 2
+
+  struct prof_stats {
+    unsigned long frames;           /* frames seen since profiling started */
+    int fps;                        /* frames during the last second */
+    unsigned long p50;              /* median frame time, in microseconds */
+    unsigned long p99;              /* 99th percentile of frame times, in microseconds */
+    unsigned long counter[PROF_COUNTERS];  /* counters of the last frame */
+  };
+
+  /* starts profiling. does nothing, and returns non-zero, if out of memory.
+   * only the thread that calls prof_init() is profiled, calls from other
+   * threads are ignored */
+  int prof_init(void);
+
+  /* returns non-zero if profiling is on */
+  int prof_enabled(void);
+
+  /* marks the start and the end of a zone. zones can nest, but a zone can't
+   * be entered again before it ends */
+  void prof_begin(int zone);
+  void prof_end(int zone);
+
+  /* adds n to a counter of the current frame */
+  void prof_count(int counter, int n);
+
+  /* marks the end of a frame */
+  void prof_frame(void);
+
+  /* computes the stats of the recent frames */
+  void prof_getstats(struct prof_stats *stats);
+
+  /* writes all recorded zones to a file: as a Chrome trace if its name ends
+   * with .json, as CSV otherwise. returns 0 on success */
+  int prof_dump(char *filename);
+
+  /* stops profiling and frees its memory */
+  void prof_close(void);
+
+#endif
@@ -0,0 +1,326 @@
+/*
+ * This file is part of the Atomiks project
+ * Copyright (C) Mateusz Viste 2013, 2014, 2015
+ *
+ * Headless level verifier for Atomiks: solves every level file found in a
+ * directory and reports the results as JSON on stdout.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>    /* atoi(), atol(), malloc(), qsort(), free() */
+#include <string.h>    /* strcmp(), strlen() */
+#include <time.h>
+#include <sys/time.h>  /* gettimeofday() */
+#include <dirent.h>    /* opendir(), readdir() */
+#include <pthread.h>
+#include "atomcore.h"
+#include "atomsolve.h"
+
+#define VERIFY_UNREADABLE -100  /* pseudo solver result: the level file could not be loaded */
+#define VERIFY_INVALID -101     /* pseudo solver result: replaying the solution didn't solve the level */
+#define VERIFY_MAXNODES 2000000 /* default limits of a single level, so a whole run can't eat all the memory */
+#define VERIFY_MAXMEMORY 1024   /* MiB */
+
+struct levelresult {
+  int level;
+  int result;                   /* one of the ATOMIX_SOLVE_xxx values, or VERIFY_UNREADABLE */
+  int atoms;
+  char title[32];
+  struct atomix_solution solution;
+};
+
+struct verifyjob {
+  struct levelresult *results;
+  int count;
+  int next;                     /* next level to be verified, taken under lock */
+  int printed;                  /* number of results printed so far, under lock */
+  int solved;
+  int failed;
+  pthread_mutex_t lock;
+  int threads;                  /* solver threads per level */
+  unsigned long maxnodes;
+  int flags;                    /* ATOMIX_SOLVE_xxx flags of the solver */
+  char *dir;
+};
+
+
+static int cmplevel(const void *a, const void *b) {
+  return(((struct levelresult *)a)->level - ((struct levelresult *)b)->level);
+}
+
+
+/* returns the level number of a file named levNNNN.dat, or -1 if the name does not look like a level file */
+static int levelfromname(char *name) {
+  int i;
+  if (strlen(name) != 11) return(-1);
+  if ((name[0] != 'l') || (name[1] != 'e') || (name[2] != 'v')) return(-1);
+  if (strcmp(name + 7, ".dat") != 0) return(-1);
+  for (i = 3; i < 7; i++) if ((name[i] < '0') || (name[i] > '9')) return(-1);
+  return(atoi(name + 3));
+}
+
+
+/* lists the levels of a directory into a sorted array. returns the number of levels found, or -1 on error */
+static int listlevels(char *dir, struct levelresult **results) {
+  DIR *dd;
+  struct dirent *entry;
+  struct levelresult *newlist;
+  int count = 0, size = 0, level;
+  *results = NULL;
+  dd = opendir(dir);
+  if (dd == NULL) return(-1);
+  while ((entry = readdir(dd)) != NULL) {
+    level = levelfromname(entry->d_name);
+    if (level <= 0) continue;
+    if (count == size) {
+      size = size * 2 + 64;
+      newlist = realloc(*results, size * sizeof(struct levelresult));
+      if (newlist == NULL) {
+        closedir(dd);
+        return(-1);
+      }
+      *results = newlist;
+    }
+    memset(&((*results)[count]), 0, sizeof(struct levelresult));
+    (*results)[count].level = level;
+    count++;
+  }
+  closedir(dd);
+  if (count > 0) qsort(*results, count, sizeof(struct levelresult), cmplevel);
+  return(count);
+}
+
+
+/* plays the solution found on the game, making sure it really solves the level */
+static void replaysolution(struct levelresult *res, struct atomixgame *game) {
+  struct atomix_move *m;
+  int i;
+  for (i = 0; i < res->solution.movecount; i++) {
+    m = &(res->solution.moves[i]);
+    if (atomix_playmove(game, m->x, m->y, m->direction, 0) != m->distance) break;
+  }
+  if ((i < res->solution.movecount) || (atomix_checksolution(game) == 0)) res->result = VERIFY_INVALID;
+}
+
+
+/* loads and solves a single level */
+static void verifylevel(struct verifyjob *job, struct levelresult *res, struct atomixgame *game) {
+  int i;
+  if (atomix_loadgame(game, res->level, ATOMIX_SRC_FILE, NULL) != 0) {
+    res->result = VERIFY_UNREADABLE;
+    return;
+  }
+  res->atoms = game->atomcount;
+  /* trailing spaces are only padding */
+  sprintf(res->title, "%.15s %.15s", game->level_desc_line1, game->level_desc_line2);
+  for (i = strlen(res->title) - 1; (i >= 0) && (res->title[i] == ' '); i--) res->title[i] = 0;
+  res->result = atomix_solve_parallel(game, job->threads, job->maxnodes, job->flags, NULL, &(res->solution));
+  if (res->result == ATOMIX_SOLVE_FOUND) replaysolution(res, game);
+}
+
+
+static char *resultname(int result) {
+  switch (result) {
+    case ATOMIX_SOLVE_FOUND:
+      return("solved");
+    case ATOMIX_SOLVE_NOSOLUTION:
+      return("unsolvable");
+    case ATOMIX_SOLVE_ABORTED:
+      return("aborted");
+    case VERIFY_UNREADABLE:
+      return("unreadable");
+    case VERIFY_INVALID:
+      return("invalid");
+    default:
+      return("error");
+  }
+}
+
+
+/* prints a string as a JSON string literal */
+static void printjsonstr(char *s) {
+  putchar('"');
+  for (; *s != 0; s++) {
+    if ((*s == '"') || (*s == '\\')) {
+        printf("\\%c", *s);
+      } else if ((unsigned char)*s < 32) {
+        printf("\\u%04x", (unsigned char)*s);
+      } else {
+        putchar(*s);
+    }
+  }
+  putchar('"');
+}
+
+
+static void printresult(char *dir, struct levelresult *res) {
+  static char dirchar[4] = "URDL";  /* directions, as in atomix_move */
+  char levelfile[300];
+  int i;
+  sprintf(levelfile, "%.255s/lev%04d.dat", dir, res->level);
+  printf("    {\"level\": %d, \"file\": ", res->level);
+  printjsonstr(levelfile);
+  printf(", \"status\": \"%s\"", resultname(res->result));
+  if (res->result == VERIFY_UNREADABLE) {
+    printf("}");
+    return;
+  }
+  printf(", \"title\": ");
+  printjsonstr(res->title);
+  printf(", \"atoms\": %d", res->atoms);
+  if (res->result == ATOMIX_SOLVE_FOUND) {
+      printf(", \"moves\": %d, \"solution\": \"", res->solution.movecount);
+      for (i = 0; i < res->solution.movecount; i++) {
+        if (i > 0) putchar(' ');
+        printf("%d,%d%c%d", res->solution.moves[i].x, res->solution.moves[i].y, dirchar[res->solution.moves[i].direction & 3], res->solution.moves[i].distance);
+      }
+      printf("\", \"optimal\": %s", res->solution.optimal ? "true" : "false");
+    } else {
+      printf(", \"moves\": null");
+  }
+  printf(", \"lowerbound\": %d", res->solution.lowerbound);
+  printf(", \"seconds\": %.3f, \"memory\": %lu, \"expanded\": %lu, \"generated\": %lu, \"stored\": %lu}", res->solution.seconds, res->solution.memory, res->solution.expanded, res->solution.generated, res->solution.stored);
+}
+
+
+/* worker thread, verifying levels until there is none left */
+static void *verifythread(void *arg) {
+  struct verifyjob *job = arg;
+  struct atomixgame *game;
+  int i;
+  game = atomix_initgame();
+  for (;;) {
+    pthread_mutex_lock(&(job->lock));
+    i = job->next++;
+    pthread_mutex_unlock(&(job->lock));
+    if (i >= job->count) break;
+    if (game == NULL) {
+        job->results[i].result = ATOMIX_SOLVE_ERROR;
+      } else {
+        verifylevel(job, &(job->results[i]), game);
+    }
+    /* print the result right away, so a run that gets killed still tells something */
+    pthread_mutex_lock(&(job->lock));
+    if (job->printed++ > 0) printf(",\n");
+    printresult(job->dir, &(job->results[i]));
+    fflush(stdout);
+    if (job->results[i].result == ATOMIX_SOLVE_FOUND) {
+        job->solved++;
+      } else {
+        job->failed++;
+    }
+    pthread_mutex_unlock(&(job->lock));
+    atomix_freesolution(&(job->results[i].solution));
+  }
+  free(game);
+  return(NULL);
+}
+
+
+static void help(void) {
+  puts("Usage: atomiks-verify [-j jobs] [-t threads] [-n maxnodes] [-m mib] [-a] [directory]\n"
+       "\n"
+       "Solves every levNNNN.dat file of directory (lev by default) and prints the\n"
+       "results as JSON, every level as soon as it is done.\n");
+  puts("  -j jobs      number of levels to solve at the same time (default: 1)\n"
+       "  -t threads   number of solver threads per level (default: 1)\n"
+       "  -n maxnodes  max number of states to expand per level, 0 for no limit\n"
+       "               (default: 2000000)\n"
+       "  -m mib       max memory of the states of a level, in MiB, 0 for no limit\n"
+       "               (default: 1024)");
+  puts("  -a           levels that can't be solved optimally within these limits get\n"
+       "               a solution that may not be the shortest, if any can be found\n"
+       "               with as many states again\n");
+  puts("Returns 0 if all levels are solvable, 1 if any is not, or could not be\n"
+       "verified, and 2 on usage or system error.");
+}
+
+
+int main(int argc, char **argv) {
+  struct verifyjob job;
+  struct atomixgame *game;
+  pthread_t *tid;
+  struct timeval starttime, endtime;
+  unsigned long maxmemory = VERIFY_MAXMEMORY;
+  int jobs = 1, i;
+  memset(&job, 0, sizeof(job));
+  job.threads = 1;
+  job.maxnodes = VERIFY_MAXNODES;
+  job.dir = "lev";
+
+  for (i = 1; i < argc; i++) {
+    if ((strcmp(argv[i], "-j") == 0) && (i + 1 < argc)) {
+        jobs = atoi(argv[++i]);
+      } else if ((strcmp(argv[i], "-t") == 0) && (i + 1 < argc)) {
+        job.threads = atoi(argv[++i]);
+      } else if ((strcmp(argv[i], "-n") == 0) && (i + 1 < argc)) {
+        job.maxnodes = atol(argv[++i]);
+      } else if ((strcmp(argv[i], "-m") == 0) && (i + 1 < argc)) {
+        maxmemory = atol(argv[++i]);
+      } else if (strcmp(argv[i], "-a") == 0) {
+        job.flags |= ATOMIX_SOLVE_ANYSOLUTION;
+      } else if ((argv[i][0] != '-') && (i + 1 == argc)) {
+        job.dir = argv[i];
+      } else {
+        help();
+        return(2);
+    }
+  }
+  if (jobs < 1) jobs = 1;
+  if (job.threads < 1) job.threads = 1;
+
+  /* initializes the core's tables before any thread uses them */
+  game = atomix_initgame();
+  if (game == NULL) {
+    fprintf(stderr, "Error: out of memory\n");
+    return(2);
+  }
+  free(game);
+  atomix_setleveldir(job.dir);
+  atomix_setsolvememory(maxmemory * 1024 * 1024);
+
+  job.count = listlevels(job.dir, &(job.results));
+  if (job.count < 0) {
+    fprintf(stderr, "Error: failed to list levels in '%s'\n", job.dir);
+    return(2);
+  }
+  if (jobs > job.count) jobs = job.count;
+
+  gettimeofday(&starttime, NULL);
+  pthread_mutex_init(&(job.lock), NULL);
+  tid = malloc((jobs + 1) * sizeof(pthread_t));
+  if (tid == NULL) {
+    fprintf(stderr, "Error: out of memory\n");
+    return(2);
+  }
+  printf("{\n  \"levels\": [\n");
+  fflush(stdout);
+  for (i = 1; i < jobs; i++) {
+    if (pthread_create(&(tid[i]), NULL, verifythread, &job) != 0) break;
+  }
+  verifythread(&job);
+  while (--i > 0) pthread_join(tid[i], NULL);
+  free(tid);
+  pthread_mutex_destroy(&(job.lock));
+  gettimeofday(&endtime, NULL);
+
+  if (job.printed > 0) printf("\n");
+  printf("  ],\n  \"count\": %d, \"solved\": %d, \"failed\": %d, \"seconds\": %.3f\n}\n", job.count, job.solved, job.failed, (endtime.tv_sec - starttime.tv_sec) + (endtime.tv_usec - starttime.tv_usec) / 1000000.0);
+  free(job.results);
+
+  if (job.failed != 0) return(1);
+  return(0);
+}